@@ -0,0 +1,339 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// HTTP load generator for the API. No dependencies beyond POSIX sockets.
+//
+// Closed loop: every connection sends its next request as soon as the previous one is answered.
+// Open loop: requests are scheduled at a fixed rate and their latency is measured from the
+// scheduled time, so a slow server is not hidden by the client waiting (coordinated omission).
+//
+// The result is one JSON object on stdout.
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string address = "127.0.0.1";
+    int port = 8003;
+    std::string host_header = "localhost";
+    std::string origin;
+    std::string mode = "closed";
+    std::string method = "GET";
+    std::vector<std::string> paths;
+    std::string content_type = "image/jpeg";
+    size_t body_bytes = 64 * 1024;
+    int connections = 16;
+    double duration = 10;
+    double rate = 1000;
+    std::string label = "load";
+};
+
+struct Sample {
+    std::vector<uint64_t> latencies_ns;
+    std::map<int, uint64_t> statuses;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+};
+
+// ────────────────────────
+//      HTTP client
+// ────────────────────────
+
+class Connection {
+public:
+    explicit Connection(const Options& options) : options(options) {}
+    ~Connection() { disconnect(); }
+
+    // Devuelve el status o -1 si la conexión falló
+    int request(const std::string& raw, uint64_t& body_bytes) {
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            if (fd < 0 && !connectSocket()) return -1;
+            if (sendAll(raw)) {
+                int status = readResponse(body_bytes);
+                if (status > 0) return status;
+            }
+            // Keep-alive cerrado por el servidor: se reintenta una vez en una conexión nueva
+            disconnect();
+        }
+        return -1;
+    }
+
+private:
+    bool connectSocket() {
+        addrinfo hints{}, *result = nullptr;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(options.address.c_str(), std::to_string(options.port).c_str(), &hints, &result) != 0)
+            return false;
+
+        for (addrinfo* info = result; info; info = info->ai_next) {
+            fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+            if (fd < 0) continue;
+            if (connect(fd, info->ai_addr, info->ai_addrlen) == 0) break;
+            close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(result);
+        if (fd < 0) return false;
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        buffer.clear();
+        return true;
+    }
+
+    void disconnect() {
+        if (fd >= 0) close(fd);
+        fd = -1;
+        buffer.clear();
+    }
+
+    bool sendAll(const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            sent += n;
+        }
+        return true;
+    }
+
+    bool fill() {
+        char chunk[64 * 1024];
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
+        return true;
+    }
+
+    int readResponse(uint64_t& body_bytes) {
+        size_t header_end;
+        while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos)
+            if (!fill()) return -1;
+
+        std::string headers = buffer.substr(0, header_end);
+        int status = std::atoi(headers.c_str() + headers.find(' ') + 1);
+
+        std::string lower = headers;
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        size_t length_pos = lower.find("\r\ncontent-length:");
+        size_t length = length_pos == std::string::npos ? 0 : std::strtoull(lower.c_str() + length_pos + 17, nullptr, 10);
+        bool closing = lower.find("\r\nconnection: close") != std::string::npos;
+
+        size_t total = header_end + 4 + length;
+        while (buffer.size() < total)
+            if (!fill()) return -1;
+
+        buffer.erase(0, total);
+        body_bytes = length;
+        if (closing) disconnect();
+        return status;
+    }
+
+    const Options& options;
+    int fd = -1;
+    std::string buffer;
+};
+
+static std::string buildRequest(const Options& options, const std::string& path, const std::string& extra_headers,
+                                const std::string& body) {
+    std::string raw = options.method + " " + path + " HTTP/1.1\r\n";
+    raw += "Host: " + options.host_header + "\r\n";
+    if (!options.origin.empty()) raw += "Origin: " + options.origin + "\r\n";
+    raw += extra_headers;
+    if (options.method == "POST") {
+        raw += "Content-Type: " + options.content_type + "\r\n";
+        raw += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    raw += "\r\n";
+    raw += body;
+    return raw;
+}
+
+// Extrae un string del JSON de /token, deshaciendo los escapes
+static std::string jsonString(const std::string& json, const std::string& key) {
+    size_t pos = json.find("\"" + key + "\"");
+    if (pos == std::string::npos) return "";
+    pos = json.find_first_not_of(": ", pos + key.size() + 2);
+    if (pos == std::string::npos || json[pos] != '"') return "";
+    std::string value;
+    for (++pos; pos < json.size() && json[pos] != '"'; ++pos) {
+        if (json[pos] == '\\' && pos + 1 < json.size()) ++pos;
+        value += json[pos];
+    }
+    return value;
+}
+
+// Los POST necesitan un token con usos suficientes para toda la prueba
+static std::string fetchTokenHeaders(const Options& options) {
+    int sock = -1;
+    addrinfo hints{}, *result = nullptr;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(options.address.c_str(), std::to_string(options.port).c_str(), &hints, &result) != 0) return "";
+    sock = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    bool connected = sock >= 0 && connect(sock, result->ai_addr, result->ai_addrlen) == 0;
+    freeaddrinfo(result);
+    if (!connected) {
+        if (sock >= 0) close(sock);
+        return "";
+    }
+
+    std::string raw = "GET /token/1000000000 HTTP/1.1\r\nHost: " + options.host_header + "\r\n";
+    if (!options.origin.empty()) raw += "Origin: " + options.origin + "\r\n";
+    raw += "Connection: close\r\n\r\n";
+    send(sock, raw.data(), raw.size(), MSG_NOSIGNAL);
+
+    std::string response;
+    char chunk[4096];
+    for (ssize_t n; (n = recv(sock, chunk, sizeof(chunk), 0)) > 0;) response.append(chunk, n);
+    close(sock);
+
+    std::string session_id = jsonString(response, "session_id");
+    std::string csrf_token = jsonString(response, "csrf_token");
+    if (session_id.empty() || csrf_token.empty()) return "";
+    return "X-Session-ID: " + session_id + "\r\nX-CSRF-Token: " + csrf_token + "\r\n";
+}
+
+// ────────────────────────
+//      Load loops
+// ────────────────────────
+
+static void worker(const Options& options, const std::vector<std::string>& requests, int index, Clock::time_point start,
+                   Sample& sample) {
+    Connection connection(options);
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration));
+    bool open_loop = options.mode == "open";
+
+    // En lazo abierto cada conexión reparte una fracción fija del ritmo total
+    Clock::duration interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.connections / std::max(options.rate, 0.001)));
+    Clock::time_point scheduled = start + interval * index / options.connections;
+
+    for (size_t i = index;; i += options.connections) {
+        Clock::time_point sent;
+        if (open_loop) {
+            if (scheduled >= end) break;
+            std::this_thread::sleep_until(scheduled);
+            sent = scheduled;
+            scheduled += interval;
+        } else {
+            sent = Clock::now();
+            if (sent >= end) break;
+        }
+
+        uint64_t body_bytes = 0;
+        int status = connection.request(requests[i % requests.size()], body_bytes);
+        uint64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - sent).count();
+
+        if (status < 0) {
+            sample.errors++;
+            continue;
+        }
+        sample.latencies_ns.push_back(latency);
+        sample.statuses[status]++;
+        sample.bytes += body_bytes;
+    }
+}
+
+static double percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[index] / 1000.0;
+}
+
+static void usage() {
+    std::fprintf(stderr,
+        "usage: load_gen [--address A] [--port P] [--host-header H] [--origin O] [--mode closed|open]\n"
+        "                [--method GET|POST] --path P [--path P ...] [--content-type T] [--body-bytes N]\n"
+        "                [--connections C] [--duration S] [--rate R] [--label L]\n");
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--address") options.address = value;
+        else if (arg == "--port") options.port = std::atoi(value.c_str());
+        else if (arg == "--host-header") options.host_header = value;
+        else if (arg == "--origin") options.origin = value;
+        else if (arg == "--mode") options.mode = value;
+        else if (arg == "--method") options.method = value;
+        else if (arg == "--path") options.paths.push_back(value);
+        else if (arg == "--content-type") options.content_type = value;
+        else if (arg == "--body-bytes") options.body_bytes = std::strtoull(value.c_str(), nullptr, 10);
+        else if (arg == "--connections") options.connections = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--duration") options.duration = std::atof(value.c_str());
+        else if (arg == "--rate") options.rate = std::atof(value.c_str());
+        else if (arg == "--label") options.label = value;
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (options.paths.empty() || (options.mode != "open" && options.mode != "closed")) {
+        usage();
+        return 2;
+    }
+
+    std::string extra_headers, body;
+    if (options.method == "POST") {
+        extra_headers = fetchTokenHeaders(options);
+        if (extra_headers.empty()) {
+            std::fprintf(stderr, "Cannot get a CSRF token from /token\n");
+            return 1;
+        }
+        body.assign(options.body_bytes, 'x');
+    }
+
+    std::vector<std::string> requests;
+    for (const std::string& path : options.paths)
+        requests.push_back(buildRequest(options, path, extra_headers, body));
+
+    std::vector<Sample> samples(options.connections);
+    std::vector<std::thread> threads;
+    Clock::time_point start = Clock::now() + std::chrono::milliseconds(50);
+    for (int i = 0; i < options.connections; ++i)
+        threads.emplace_back(worker, std::cref(options), std::cref(requests), i, start, std::ref(samples[i]));
+    for (auto& thread : threads) thread.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    Sample total;
+    for (Sample& sample : samples) {
+        total.latencies_ns.insert(total.latencies_ns.end(), sample.latencies_ns.begin(), sample.latencies_ns.end());
+        for (auto [status, count] : sample.statuses) total.statuses[status] += count;
+        total.errors += sample.errors;
+        total.bytes += sample.bytes;
+    }
+    std::sort(total.latencies_ns.begin(), total.latencies_ns.end());
+
+    std::string statuses;
+    for (auto [status, count] : total.statuses)
+        statuses += (statuses.empty() ? "\"" : ",\"") + std::to_string(status) + "\":" + std::to_string(count);
+
+    std::printf("{\"label\":\"%s\",\"mode\":\"%s\",\"method\":\"%s\",\"connections\":%d,\"target_rate\":%.1f,"
+                "\"duration_s\":%.3f,\"requests\":%zu,\"errors\":%llu,\"throughput_rps\":%.1f,\"bytes_per_s\":%.1f,"
+                "\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f,\"status\":{%s}}\n",
+                options.label.c_str(), options.mode.c_str(), options.method.c_str(), options.connections,
+                options.mode == "open" ? options.rate : 0.0, elapsed, total.latencies_ns.size(),
+                static_cast<unsigned long long>(total.errors), total.latencies_ns.size() / elapsed,
+                total.bytes / elapsed, percentile(total.latencies_ns, 0.50), percentile(total.latencies_ns, 0.99),
+                percentile(total.latencies_ns, 0.999),
+                total.latencies_ns.empty() ? 0.0 : total.latencies_ns.back() / 1000.0, statuses.c_str());
+    return total.errors == 0 ? 0 : 1;
+}
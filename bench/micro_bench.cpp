@@ -0,0 +1,117 @@
+#include "../src/controller.h"
+#include "../src/csrf_tokens.h"
+#include "../src/disk_io.h"
+#include "../src/token_encryption.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Micro-benchmarks of the hot helpers. One JSON object per line:
+// {"bench":"<name>","param":"<param>","iterations":N,"ns_per_op":X}
+
+static size_t sink = 0;
+
+static void report(const char* bench, const std::string& param, int iterations, double ns_per_op) {
+    std::printf("{\"bench\":\"%s\",\"param\":\"%s\",\"iterations\":%d,\"ns_per_op\":%.1f}\n",
+                bench, param.c_str(), iterations, ns_per_op);
+    std::fflush(stdout);
+}
+
+static void measure(const char* bench, const std::string& param, int iterations, const std::function<void()>& op) {
+    for (int i = 0; i < iterations / 10 + 1; ++i) op();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) op();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    report(bench, param, iterations, std::chrono::duration<double, std::nano>(elapsed).count() / iterations);
+}
+
+static void tokenBenchmarks() {
+    const std::string key = "0123456789abcdef0123456789abcdef";
+    const std::string token = generate_csrf_token();
+
+    for (int rounds : {1, 2, 4}) {
+        // Cada ronda AES duplica el tamaño de la entrada, se reducen las iteraciones
+        int iterations = 100000 >> rounds;
+        std::string encrypted = encrypt_token(token, key, rounds);
+        measure("encrypt_token", "rounds=" + std::to_string(rounds), iterations,
+                [&] { sink += encrypt_token(token, key, rounds).size(); });
+        measure("decrypt_token", "rounds=" + std::to_string(rounds), iterations,
+                [&] { sink += decrypt_token(encrypted, key, rounds).size(); });
+    }
+
+    for (size_t size : {16, 32, 256, 4096}) {
+        std::vector<unsigned char> data(size, 0xA5);
+        measure("toHex", "bytes=" + std::to_string(size), 200000, [&] { sink += toHex(data).size(); });
+    }
+
+    measure("generate_csrf_token", "", 200000, [&] { sink += generate_csrf_token().size(); });
+}
+
+static void fileReadBenchmarks(const std::filesystem::path& directory) {
+    std::filesystem::create_directories(directory);
+
+    for (size_t size : {size_t{1} << 10, size_t{64} << 10, size_t{1} << 20, size_t{16} << 20}) {
+        std::string path = (directory / ("page-" + std::to_string(size) + ".jpg")).string();
+        std::ofstream(path, std::ios::binary) << std::string(size, 'x');
+
+        // Las lecturas que no salen de la caché terminan la respuesta en el hilo de la conexión,
+        // con un asio::post desde los callbacks de disk_io(): el contexto hace de conexión
+        asio::io_context connection;
+        crow::request req;
+        req.url = "/" + path;
+        req.io_context = &connection;
+
+        // Disco y conexión se alternan (stat, post, lectura, post) hasta que no queda nada pendiente
+        auto read = [&](const crow::request& request, crow::response& res) {
+            handleFileRead(request, res, path, RouteFamily::Mangas);
+            do {
+                disk_io().drain();
+                connection.restart();
+            } while (connection.run() > 0);
+        };
+        std::string param = "bytes=" + std::to_string(size);
+
+        // Archivos menores que FILE_CACHE_MAX_ENTRY_BYTES salen de la caché tras la primera lectura
+        measure("handleFileRead", param, size >= (size_t{1} << 20) ? 2000 : 20000, [&] {
+            crow::response res;
+            read(req, res);
+            sink += res.body.size() + res.code;
+        });
+
+        crow::response first;
+        read(req, first);
+        crow::request conditional = req;
+        conditional.add_header("If-None-Match", first.get_header_value("ETag"));
+        measure("handleFileRead_304", param, 20000, [&] {
+            crow::response res;
+            read(conditional, res);
+            sink += res.code;
+        });
+
+        crow::request ranged = req;
+        ranged.add_header("Range", "bytes=0-1023");
+        measure("handleFileRead_range", param, 20000, [&] {
+            crow::response res;
+            read(ranged, res);
+            sink += res.body.size();
+        });
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+int main(int argc, char** argv) {
+    // El directorio de trabajo se puede cambiar para medir otro sistema de archivos
+    std::filesystem::path directory = argc > 1 ? argv[1] : "bench/bin/fixtures";
+
+    tokenBenchmarks();
+    fileReadBenchmarks(directory);
+
+    if (sink == 0) std::puts("");
+}
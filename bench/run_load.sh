@@ -0,0 +1,75 @@
+#!/bin/bash
+
+# This script runs the load scenarios of bench/load_gen against a local ./app
+# Everything runs offline: the app uses the in-process token store, or a local redis-server with --redis
+# Every scenario prints one JSON line; redirect stdout to keep the results of a release
+#
+# Usage: bench/run_load.sh [--redis]
+# Environment: APP (./app), PORT (18003), DURATION (10 seconds per scenario), RATE (2000 req/s for open loop)
+
+APP=$(realpath "${APP:-./app}")
+LOAD_GEN=$(realpath bench/bin/load_gen)
+PORT=${PORT:-18003}
+DURATION=${DURATION:-10}
+RATE=${RATE:-2000}
+HOST=bench.local
+
+if [ ! -x "$APP" ] || [ ! -x "$LOAD_GEN" ]; then
+    echo "Build the app with ./compile.sh and the benchmarks with ./compile_bench.sh first" >&2
+    exit 1
+fi
+
+workdir=$(mktemp -d)
+pids=()
+cleanup() {
+    for pid in "${pids[@]}"; do kill "$pid" 2> /dev/null; done
+    wait 2> /dev/null
+    rm -rf "$workdir"
+}
+trap cleanup EXIT
+
+cat > "$workdir/.env" << ENV
+CORS_ORIGIN=http://$HOST
+ALLOWED_HOSTS=$HOST
+ENCRYPTION_ROUNDS=1
+ENCRYPTION_KEY=bench-key
+CROW_HOST=127.0.0.1
+CROW_PORT=$PORT
+TOKEN_STORE=memory
+ENV
+
+if [ "$1" == "--redis" ]; then
+    redis_port=$((PORT + 1))
+    redis-server --port "$redis_port" --save '' --appendonly no > /dev/null &
+    pids+=($!)
+    sed -i 's/^TOKEN_STORE=memory$/TOKEN_STORE=redis/' "$workdir/.env"
+    echo "REDIS_URL=tcp://127.0.0.1:$redis_port" >> "$workdir/.env"
+fi
+
+# Fixtures: un capítulo de páginas de 64 KiB, uno de 4 MiB y uno vacío para los POST
+mkdir -p "$workdir/Mangas/bench/slug/1" "$workdir/Mangas/bench/slug/2" "$workdir/Mangas/bench/slug/3" "$workdir/Media"
+for page in 1 2 3 4 5 6 7 8; do
+    head -c 65536 /dev/urandom > "$workdir/Mangas/bench/slug/1/$page.jpg"
+done
+head -c 4194304 /dev/urandom > "$workdir/Mangas/bench/slug/2/1.jpg"
+
+(cd "$workdir" && exec "$APP" > "$workdir/app.log" 2>&1) &
+pids+=($!)
+
+for _ in $(seq 50); do
+    curl -s -o /dev/null "http://127.0.0.1:$PORT/beep" && break
+    sleep 0.1
+done
+
+run() {
+    "$LOAD_GEN" --port "$PORT" --host-header "$HOST" --duration "$DURATION" "$@"
+}
+
+small_pages=()
+for page in 1 2 3 4 5 6 7 8; do small_pages+=(--path "/Mangas/bench/slug/1/$page"); done
+
+run --label get_page_64k_closed --mode closed --connections 32 "${small_pages[@]}"
+run --label get_page_64k_open --mode open --rate "$RATE" --connections 32 "${small_pages[@]}"
+run --label get_page_4m_closed --mode closed --connections 8 --path /Mangas/bench/slug/2/1
+run --label post_page_64k_closed --mode closed --connections 8 --method POST --body-bytes 65536 \
+    --content-type image/jpeg --path /Mangas/bench/slug/3/1
@@ -2,7 +2,17 @@
 
 start_time=$(date +%s)
 
-g++ main.cpp src/cpp/*.cpp -Wall -Werror -pedantic -lm -lpthread -lredis++ -lssl -lcrypto -lhiredis -std=c++20 -o app
+# liburing, zstd and the async Redis client are optional: the sources check them with __has_include,
+# so each one is linked only when the same compiler can find its header
+has_header() {
+    echo "#include <$1>" | g++ -std=c++20 -E -x c++ - > /dev/null 2>&1
+}
+optional_libs=""
+has_header liburing.h && optional_libs="$optional_libs -luring"
+has_header zstd.h && optional_libs="$optional_libs -lzstd"
+has_header sw/redis++/async_redis++.h && optional_libs="$optional_libs -luv"
+
+g++ main.cpp src/cpp/*.cpp -Wall -Werror -pedantic -lm -lpthread -lredis++ -lssl -lcrypto -lhiredis -lz -ljpeg -lpng $optional_libs -std=c++20 -o app
 
 if [ $? -ne 0 ]; then
     echo "\e[31m"
@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# This script compiles the benchmarks in bench/ with G++
+# Every benchmark is a standalone binary written to bench/bin/
+#   token_encryption_bench -> token derivation per mode and round count
+#   micro_bench            -> token helpers and handleFileRead across file sizes (JSON lines)
+#   load_gen               -> closed/open loop HTTP load generator, run through bench/run_load.sh
+
+mkdir -p bench/bin
+
+# Optional libraries are linked only when their header is installed, as in compile.sh
+has_header() {
+    echo "#include <$1>" | g++ -std=c++20 -E -x c++ - > /dev/null 2>&1
+}
+optional_libs=""
+has_header liburing.h && optional_libs="$optional_libs -luring"
+has_header zstd.h && optional_libs="$optional_libs -lzstd"
+has_header sw/redis++/async_redis++.h && optional_libs="$optional_libs -luv"
+
+g++ bench/token_encryption_bench.cpp src/cpp/token_encryption.cpp -O2 -Wall -Werror -pedantic -lssl -lcrypto -std=c++20 -o bench/bin/token_encryption_bench || exit 1
+
+g++ bench/micro_bench.cpp src/cpp/*.cpp -O2 -Wall -Werror -pedantic -lm -lpthread -lredis++ -lssl -lcrypto -lhiredis -lz -ljpeg -lpng $optional_libs -std=c++20 -o bench/bin/micro_bench || exit 1
+
+g++ bench/load_gen.cpp -O2 -Wall -Werror -pedantic -lpthread -std=c++20 -o bench/bin/load_gen || exit 1
+
+echo "Benchmarks compiled in bench/bin/"
@@ -1,16 +1,43 @@
 #include "crow.h"
 #include "crow/middlewares/cors.h"
 #include "./src/controller.h"
+#include "./src/env_loader.h"
+#include "./src/config.h"
+#include "./src/path_index.h"
+#include "./src/content_store.h"
+#include "./src/storage_layout.h"
+#include <cstring>
+#include <iostream>
+#include <thread>
 
-int main() {
-    crow::App<crow::CORSHandler> app;
+// ./app --migrate-layout [--dry-run]: mueve los archivos al layout de STORAGE_LAYOUT y termina
+static int migrateLayout(bool dry_run) {
+    auto grace = std::chrono::milliseconds(std::max(0LL, env_integer("STORAGE_MIGRATION_GRACE_MS", 2000)));
+    LayoutMigrationStats stats = migrate_layout({"Mangas", "Media"}, storage_layout(), grace, dry_run);
+    std::cout << (dry_run ? "Would move " : "Moved ") << stats.moved << " files, "
+              << stats.superseded << " superseded, " << stats.failed << " failed, "
+              << stats.directories << " directories removed" << std::endl;
+    return stats.failed == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::strcmp(argv[1], "--migrate-layout") == 0)
+        return migrateLayout(argc > 2 && std::strcmp(argv[2], "--dry-run") == 0);
+
+    crow::App<crow::CORSHandler, MetricsMiddleware, AdmissionMiddleware> app;
     /* auto& cors = app.get_middleware<crow::CORSHandler>();
     cors
         .global()
-        .origin(ENV["CORS_ORIGIN"])
+        .origin(config().cors_origin)
         .methods("POST"_method, "GET"_method, "OPTIONS"_method)
         .headers("Content-Type, Authorization, session_id, csrf_token"); */
 
+    path_index().start({"Mangas", "Media"}, std::max(1u, std::thread::hardware_concurrency()));
+    content_store().start({"Mangas", "Media"});
+    start_config_watcher();
     setup_routes(app);
-    app.bindaddr(ENV["CROW_HOST"]).port(stoi(ENV["CROW_PORT"])).multithreaded().run();
+    app.bindaddr(env_string("CROW_HOST", "0.0.0.0"))
+        .port(static_cast<uint16_t>(env_integer("CROW_PORT", 8003)))
+        .multithreaded()
+        .run();
 }
\ No newline at end of file
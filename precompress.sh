@@ -0,0 +1,23 @@
+#!/bin/bash
+
+# This script writes the .gz and .zst sidecars of the website assets
+# The server serves a sidecar instead of compressing on the fly when the client accepts its encoding
+# and the sidecar is not older than the original, so run it again after changing an asset
+
+root=${1:-Media/Website}
+
+if [ ! -d "$root" ]; then
+    echo "No assets directory: $root"
+    exit 1
+fi
+
+count=0
+while IFS= read -r -d '' file; do
+    gzip -9 -k -f -n "$file" || exit 1
+    if command -v zstd > /dev/null; then
+        zstd -19 -q -f "$file" -o "$file.zst" || exit 1
+    fi
+    count=$((count + 1))
+done < <(find "$root" -type f \( -name '*.css' -o -name '*.js' -o -name '*.svg' -o -name '*.ttf' -o -name '*.otf' \) -print0)
+
+echo "Precompressed $count assets in $root"
@@ -0,0 +1,116 @@
+#ifndef __ADMISSION_H__
+#define __ADMISSION_H__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "crow.h"
+
+/**
+* Route families admitted separately. Exempt requests (/metrics, /stats, /beep, OPTIONS)
+* are never limited, so the server can still be observed while it sheds load.
+**/
+enum class AdmissionClass { Read, Write, Exempt };
+
+/**
+* Outcome of asking to start a request.
+* Admitted: the request runs and must be released when it finishes
+* Overloaded: too many requests of its class in flight, or it is too slow (503)
+* RateLimited: the client spent its token bucket (429)
+**/
+enum class AdmissionResult { Admitted, Overloaded, RateLimited };
+
+/**
+* @brief Admission control in front of the routes.
+* Reads and writes have their own in-flight limit. A request is in flight from the moment
+* it is admitted until its response is finished, so disk writes and Redis calls queued by
+* asynchronous handlers count against the limit. The latency of finished requests is
+* smoothed per class; while reads or writes are slower than their threshold, writes are
+* only allowed a quarter of their limit, so an upload spike cannot starve the GETs.
+* Each class also has a token bucket per client IP; X-Session-ID is chosen by the client and is
+* not validated yet at this point, so it cannot be trusted as a key. Every shard keeps at most
+* MAX_BUCKETS_PER_SHARD buckets and forgets the client that has been idle the longest.
+* Limits are read from config() on every request and follow reloads.
+**/
+class Admission {
+public:
+    /**
+    * @brief Classifies a request and, unless it is exempt, tries to admit it
+    * @param req The request
+    * @param cls Output: the class of the request
+    * @param retry_after Output: seconds the client should wait when it is not admitted
+    * @return Whether the request may run
+    **/
+    AdmissionResult admit(const crow::request& req, AdmissionClass& cls, int64_t& retry_after);
+
+    /**
+    * @brief Frees the slot of an admitted request and records how long it took
+    * @param cls The class returned by admit
+    * @param elapsed Time from admission to the end of the response
+    **/
+    void release(AdmissionClass cls, std::chrono::steady_clock::duration elapsed);
+
+    /**
+    * @return Number of admitted requests of a class that have not finished yet
+    **/
+    size_t inFlight(AdmissionClass cls) const;
+
+    /**
+    * @return The smoothed latency of a class in milliseconds
+    **/
+    double latencyMs(AdmissionClass cls) const;
+
+private:
+    static constexpr size_t SHARD_COUNT = 16;
+    static constexpr size_t MAX_BUCKETS_PER_SHARD = 4096;
+
+    struct Bucket {
+        double tokens;
+        int64_t updated_ns;
+        std::list<uint64_t>::iterator recent;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Bucket> buckets;
+        std::list<uint64_t> recent;   // Most recently used first
+    };
+
+    struct Family {
+        std::atomic<size_t> in_flight{0};
+        std::atomic<uint64_t> latency_ns{0};
+    };
+
+    bool take(uint64_t key, int64_t rate, int64_t burst, int64_t& retry_after);
+    bool acquire(Family& family, size_t limit);
+
+    std::array<Family, 2> families;
+    std::array<Shard, SHARD_COUNT> shards;
+};
+
+/**
+* @brief The process wide admission control
+**/
+Admission& admission();
+
+/**
+* @brief Crow middleware that answers 503 or 429 with Retry-After before the handler runs
+* when admission() rejects a request, and releases admitted requests once they finish
+**/
+struct AdmissionMiddleware {
+    struct context {
+        std::chrono::steady_clock::time_point start;
+        AdmissionClass cls = AdmissionClass::Exempt;
+        bool admitted = false;
+    };
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef __ATOMIC_FILE_H__
+#define __ATOMIC_FILE_H__
+
+#include <cstdint>
+#include <string>
+
+typedef struct evp_md_ctx_st EVP_MD_CTX;
+
+/**
+* @brief Writes a file so that readers only ever see the old or the complete new version.
+* Bytes go to a hidden temporary file in the target directory, which is fsync'ed and then
+* renamed over the target; the directory is fsync'ed afterwards so the rename survives a crash.
+* If the writer is destroyed without commit() the temporary file is removed.
+**/
+class AtomicFileWriter {
+public:
+    /**
+    * @param path The final path of the file
+    * @param checksum Whether to compute the SHA-256 of the bytes while they are written
+    **/
+    AtomicFileWriter(const std::string& path, bool checksum);
+    ~AtomicFileWriter();
+
+    AtomicFileWriter(const AtomicFileWriter&) = delete;
+    AtomicFileWriter& operator=(const AtomicFileWriter&) = delete;
+
+    /**
+    * @brief Creates the temporary file next to the target
+    * @return True if the file could be created
+    **/
+    bool open();
+
+    /**
+    * @brief Appends bytes to the temporary file
+    * @param data The bytes to write
+    * @param size The number of bytes
+    * @return True if every byte was written
+    **/
+    bool append(const char* data, size_t size);
+
+    /**
+    * @brief Appends the contents of another file, copied inside the kernel when possible
+    * @param source The file to copy
+    * @return True if the whole file was appended
+    **/
+    bool appendFile(const std::string& source);
+
+    /**
+    * @brief Flushes the file to disk and renames it over the target
+    * @return True if the new file is in place
+    **/
+    bool commit();
+
+    /**
+    * @brief Drops the temporary file, the target is left untouched
+    **/
+    void abort();
+
+    /**
+    * @return Number of bytes appended so far
+    **/
+    uintmax_t size() const { return written; }
+
+    /**
+    * @return The lowercase hex SHA-256 of the bytes, only once the checksum is finished by commit()
+    **/
+    const std::string& sha256() const { return digest; }
+
+    /**
+    * @brief Finishes the checksum without committing, so it can be compared before commit()
+    * @return The lowercase hex SHA-256 of the bytes appended so far
+    **/
+    const std::string& finishChecksum();
+
+private:
+    std::string path;
+    std::string temp_path;
+    int fd = -1;
+    uintmax_t written = 0;
+    EVP_MD_CTX* hash = nullptr;
+    std::string digest;
+};
+
+/**
+* @brief A hidden temporary path in the directory of a file, ignored by the path index and the GET routes
+* @param path The final path of the file
+**/
+std::string atomic_temp_path(const std::string& path);
+
+/**
+* @brief Publishes a fully written directory in place of another one in a single step.
+* Uses renameat2(RENAME_EXCHANGE) when the target exists, so readers see either the old
+* or the new tree, and then deletes the old tree that ended up at the staged path.
+* @param staged The directory holding the new contents
+* @param target The directory to replace (it may not exist yet)
+* @return True if the new directory is in place
+**/
+bool replace_directory(const std::string& staged, const std::string& target);
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef __CHAPTER_PACK_H__
+#define __CHAPTER_PACK_H__
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <vector>
+#include "atomic_file.h"
+
+/**
+* @brief One page in the index of a pack, 80 bytes in host byte order
+**/
+struct PackEntry {
+    uint32_t page;
+    uint32_t reserved;
+    uint64_t offset;              // From the start of the pack
+    uint64_t length;
+    char content_type[24];        // NUL padded
+    unsigned char sha256[32];
+};
+
+/**
+* @brief A sealed chapter: every page in one read-only file, mapped into memory.
+* Layout: an 8 byte magic, the bytes of every page back to back, the index (one PackEntry
+* per page, sorted by page) and a trailer with the offset of the index, the number of pages
+* and the magic again. The pack lives in the chapter directory as "chapter.pack", so it
+* moves with the chapter between storage layouts and the path index knows whether a
+* chapter is sealed without touching the disk.
+**/
+class ChapterPack {
+public:
+    static constexpr const char* FILE_NAME = "chapter.pack";
+
+    /**
+    * @brief Maps a pack and checks its index
+    * @param path The path of the pack
+    * @return The pack, or nullptr if it cannot be read or is malformed
+    **/
+    static std::shared_ptr<const ChapterPack> open(const std::string& path);
+
+    ~ChapterPack();
+
+    ChapterPack(const ChapterPack&) = delete;
+    ChapterPack& operator=(const ChapterPack&) = delete;
+
+    /**
+    * @brief Looks a page up in the mapped index
+    * @return The entry, or nullptr if the chapter was sealed without that page
+    **/
+    const PackEntry* find(int page) const;
+
+    std::span<const PackEntry> entries() const { return {index, count}; }
+
+    /**
+    * @brief The bytes of a page, straight from the mapping; touching them may read the disk
+    **/
+    const char* bytes(const PackEntry& entry) const { return static_cast<const char*>(map) + entry.offset; }
+
+    const std::string& path() const { return pack_path; }
+    const struct stat& status() const { return st; }
+
+    static std::string contentType(const PackEntry& entry);
+    static std::string hash(const PackEntry& entry);
+
+private:
+    ChapterPack() = default;
+
+    std::string pack_path;
+    struct stat st{};
+    void* map = nullptr;
+    size_t map_size = 0;
+    const PackEntry* index = nullptr;
+    size_t count = 0;
+};
+
+/**
+* @brief Writes a pack atomically; readers keep the previous pack until commit()
+**/
+class ChapterPackWriter {
+public:
+    explicit ChapterPackWriter(const std::string& path);
+
+    bool open();
+
+    /**
+    * @brief Appends a page; pages must be added in increasing order
+    * @param page The page number
+    * @param content_type The MIME type it is served with
+    * @param data The bytes of the page
+    * @param size The number of bytes
+    * @return True if the page was written
+    **/
+    bool add(int page, const std::string& content_type, const char* data, size_t size);
+
+    /**
+    * @brief Writes the index and the trailer and puts the pack in place
+    **/
+    bool commit();
+
+private:
+    AtomicFileWriter writer;
+    std::vector<PackEntry> index;
+};
+
+/**
+* @brief The mapped packs, bounded by CHAPTER_PACK_CACHE.
+* A pack is mapped on first use and stays mapped while it is cached or being served;
+* packs replaced through the server are invalidated explicitly.
+**/
+class ChapterPacks {
+public:
+    explicit ChapterPacks(size_t capacity);
+
+    /**
+    * @brief Where the pack of a chapter is, if it is sealed
+    * Answered from the path index; probes both storage layouts only when the index is not authoritative.
+    * @param chapter_key The logical key of the chapter, "Mangas/<user>/<slug>/<chapter>"
+    **/
+    std::optional<std::string> locate(const std::string& chapter_key);
+
+    /**
+    * @brief The pack at a path if it is already mapped; never touches the disk
+    **/
+    std::shared_ptr<const ChapterPack> mapped(const std::string& path);
+
+    /**
+    * @brief The pack at a path, mapping it if needed; may block on the disk
+    **/
+    std::shared_ptr<const ChapterPack> get(const std::string& path);
+
+    /**
+    * @brief Drops the mapping of a pack that was replaced or removed
+    **/
+    void invalidate(const std::string& path);
+
+private:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<const ChapterPack>> packs;
+    };
+
+    Shard& shardFor(const std::string& path);
+
+    size_t shard_capacity;
+    std::array<Shard, SHARD_COUNT> shards;
+};
+
+/**
+* @brief The process wide pack registry, sized with CHAPTER_PACK_CACHE
+**/
+ChapterPacks& chapter_packs();
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef __COMPRESSION_H__
+#define __COMPRESSION_H__
+
+#include <string>
+
+/**
+* @brief Whether zstd support was compiled in (zstd.h available at build time)
+**/
+bool zstd_available();
+
+/**
+* @brief Picks the best Content-Encoding the client accepts among zstd and gzip
+* Honours q-values, "*" and "identity;q=0" is treated as identity anyway.
+* @param accept_encoding The value of the Accept-Encoding header
+* @return "zstd", "gzip" or an empty string for identity
+**/
+std::string negotiate_encoding(const std::string& accept_encoding);
+
+/**
+* @brief File suffix of the precompressed sidecar for an encoding
+* @param encoding "gzip" or "zstd"
+* @return ".gz" or ".zst"
+**/
+std::string encoding_suffix(const std::string& encoding);
+
+/**
+* @brief Whether a Content-Type is worth compressing (text, scripts, svg, uncompressed fonts)
+* Images, videos, woff and woff2 are already compressed and are skipped.
+* @param content_type The Content-Type of the asset
+**/
+bool is_compressible(const std::string& content_type);
+
+/**
+* @brief Compresses a buffer with the given encoding
+* @param encoding "gzip" or "zstd"
+* @param input The bytes to compress
+* @param output Output: the compressed bytes
+* @return True on success
+**/
+bool compress_buffer(const std::string& encoding, const std::string& input, std::string& output);
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "token_encryption.h"
+
+/**
+* @brief Validated, typed settings read on the request path.
+* A snapshot is never modified once published; a reload builds a new one.
+* Settings that size caches, pools or shards are read once at startup with
+* env_integer() and still need a restart.
+**/
+struct Config {
+    std::string allowed_hosts;
+    std::string cors_origin;
+
+    std::string encryption_key;
+    int encryption_rounds;
+    TokenDigestMode digest_mode;
+    bool digest_migrate;
+
+    std::string cache_control_mangas;
+    std::string cache_control_profiles;
+    std::string cache_control_posts;
+    std::string cache_control_website;
+
+    uintmax_t range_max_bytes;
+    uintmax_t upload_max_bytes;
+    uintmax_t upload_batch_max_bytes;
+    bool upload_checksum;
+
+    // Admission control; 0 disables a limit
+    size_t admission_read_limit;
+    size_t admission_write_limit;
+    int64_t admission_read_latency_ms;
+    int64_t admission_write_latency_ms;
+    int64_t admission_read_rate;
+    int64_t admission_read_burst;
+    int64_t admission_write_rate;
+    int64_t admission_write_burst;
+    int64_t admission_retry_after;
+
+    // Read-ahead of chapter pages; a window of 0 disables it
+    size_t prefetch_window;
+    uintmax_t prefetch_host_budget;
+    int64_t prefetch_ttl;
+
+    // Most resources one /metadata request may ask about
+    size_t metadata_max_resources;
+};
+
+/**
+* @brief Builds a config from the variables of a .env file
+* Invalid values fall back to their defaults and are reported in errors.
+* @param values The variables as returned by load_env_file
+* @param errors Output: one message per invalid or missing variable
+* @return The new config
+**/
+std::shared_ptr<const Config> parse_config(const std::unordered_map<std::string, std::string>& values,
+                                           std::vector<std::string>& errors);
+
+/**
+* @brief The current config, without locks
+* Each thread keeps its own reference to the published snapshot and only touches the
+* shared pointer again when the version changes. The returned reference stays valid at
+* least until the next reload after the following call to config() on the same thread.
+* @return The current config
+**/
+const Config& config();
+
+/**
+* @brief Re-reads .env and publishes it if every variable is valid
+* @return True if a new config was published
+**/
+bool reload_config();
+
+/**
+* @brief Reloads the config on SIGHUP or when .env is replaced or modified
+**/
+void start_config_watcher();
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef __CONTENT_STORE_H__
+#define __CONTENT_STORE_H__
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+* @brief Deduplicating storage for uploads, keyed by the SHA-256 of their bytes.
+* Every blob is stored once in a hidden sharded directory of its root
+* ("Media/.content/ab/cd/<sha256>") and each logical path is a hardlink to it, so URLs,
+* the path index and Crow's static file path keep working unchanged. Files that share
+* a blob share one inode, and therefore one copy in the page cache. Blobs are never
+* modified in place: a re-upload links the path to another blob, and blobs left without
+* links are removed by the scan at startup. Linking a path to an existing blob touches its
+* mtime, so the Last-Modified of a path is never older than its upload.
+**/
+class ContentStore {
+public:
+    /**
+    * @param enabled Whether uploads are deduplicated
+    * @param gc_age_seconds Unlinked blobs older than this are removed by the scan
+    **/
+    ContentStore(bool enabled, int64_t gc_age_seconds);
+
+    bool enabled() const { return is_enabled; }
+
+    /**
+    * @brief Indexes the blobs of every root in the background and removes unlinked ones
+    * @param roots The storage roots, e.g. {"Mangas", "Media"}
+    **/
+    void start(const std::vector<std::string>& roots);
+
+    /**
+    * @brief Stores the bytes of an upload once and links the path to them
+    * The path is replaced atomically; missing directories are created.
+    * @param path The logical path of the upload
+    * @param data The bytes; must stay valid until done runs
+    * @param size The number of bytes
+    * @param hash The lowercase hex SHA-256 of the bytes
+    * @param done Receives 0, or -errno
+    **/
+    void store(const std::string& path, const char* data, size_t size, const std::string& hash,
+               std::function<void(int result)> done);
+
+    /**
+    * @brief Moves a file that is already written into the store; blocks on the disk
+    * If the blob exists the path is replaced by a link to it and the new copy is freed,
+    * otherwise the file itself becomes the blob.
+    * @param path The logical path of the file, its first component is the root
+    * @param hash The lowercase hex SHA-256 of its bytes
+    * @return 0, or -errno
+    **/
+    int adopt(const std::string& path, const std::string& hash);
+
+    /**
+    * @brief The SHA-256 of a file stored through the content store
+    * Blobs carry their hash in an extended attribute, so it is known before the startup
+    * scan reaches them.
+    * @param path The logical path
+    * @param st The stat of the logical path
+    * @return The hex hash, or an empty string if the file is not a known blob
+    **/
+    std::string hashOf(const std::string& path, const struct stat& st);
+
+    /**
+    * @brief Where the blob of a hash lives for a logical path
+    * @param path The logical path, its first component is the root
+    * @param hash The hex hash
+    **/
+    static std::string blobPath(const std::string& path, const std::string& hash);
+
+private:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct Blob {
+        uint64_t device;
+        std::string hash;
+    };
+
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<uint64_t, Blob> blobs;
+    };
+
+    void record(const struct stat& st, const std::string& hash);
+    void writeBlob(const std::string& path, const std::string& blob, const std::string& hash,
+                   const char* data, size_t size, std::function<void(int result)> done);
+    void link(const std::string& path, const std::string& blob, const std::string& hash, bool written,
+              const char* data, size_t size, std::function<void(int result)> done);
+    void scan(const std::vector<std::string>& roots);
+
+    Shard& shardFor(uint64_t inode) const;
+
+    bool is_enabled;
+    int64_t gc_age_seconds;
+    mutable std::array<Shard, SHARD_COUNT> shards;
+
+    // Blobs que se están escribiendo y quién espera a que terminen
+    std::mutex writing_mutex;
+    std::unordered_map<std::string, std::vector<std::function<void(int result)>>> writing;
+};
+
+/**
+* @brief The process wide content store, configured with CONTENT_STORE and CONTENT_STORE_GC_AGE
+**/
+ContentStore& content_store();
+
+#endif
@@ -3,16 +3,33 @@
 
 #include "crow.h"
 #include "crow/middlewares/cors.h"
+#include "metrics.h"
+#include "admission.h"
+
+/**
+ * @brief Route families with their own Cache-Control
+ * Pending is an original served while its downscaled variant is being generated
+**/
+enum class RouteFamily { Mangas, Profiles, Posts, Website, Pending };
+
+/**
+ * @brief Serves a media file with validators, Range support and the hot-file cache
+ * @param req The request, for conditional, Range and ?size= handling
+ * @param res The response to fill and end
+ * @param path The path of the file
+ * @param family The route family, which picks the Cache-Control
+**/
+void handleFileRead(const crow::request& req, crow::response& res, const std::string& path, RouteFamily family);
 
 /**
  * @brief Setup the routes for the application
  * @param app The crow::SimpleApp instance
 **/
-void setup_routes(crow::App<crow::CORSHandler>& app);
+void setup_routes(crow::App<crow::CORSHandler, MetricsMiddleware, AdmissionMiddleware>& app);
 
 /**
  * Environment variables from .env
 **/
-extern std::unordered_map<std::string, std::string> ENV;
+extern const std::unordered_map<std::string, std::string> ENV;
 
 #endif
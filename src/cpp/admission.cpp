@@ -0,0 +1,164 @@
+#include "../admission.h"
+#include "../config.h"
+#include "../logger.h"
+#include "../metrics.h"
+#include <algorithm>
+#include <cmath>
+
+// Peso de cada petición terminada en la latencia suavizada
+static const int64_t LATENCY_SMOOTHING = 8;
+
+static int64_t nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static AdmissionClass classify(const crow::request& req) {
+    const std::string& url = req.url;
+    if (req.method == crow::HTTPMethod::Options || url == "/metrics" || url == "/beep" || url.rfind("/stats/", 0) == 0)
+        return AdmissionClass::Exempt;
+    // La consulta de metadatos llega por POST pero solo hace stat
+    if (url == "/metadata") return AdmissionClass::Read;
+    // Emitir un token escribe en Redis: cuenta como escritura
+    if (req.method == crow::HTTPMethod::Post || url.rfind("/token/", 0) == 0) return AdmissionClass::Write;
+    return AdmissionClass::Read;
+}
+
+static const char* className(AdmissionClass cls) {
+    return cls == AdmissionClass::Write ? "write" : "read";
+}
+
+bool Admission::acquire(Family& family, size_t limit) {
+    size_t current = family.in_flight.load(std::memory_order_relaxed);
+    do {
+        if (limit > 0 && current >= limit) return false;
+    } while (!family.in_flight.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+    return true;
+}
+
+bool Admission::take(uint64_t key, int64_t rate, int64_t burst, int64_t& retry_after) {
+    int64_t now = nowNanoseconds();
+    Shard& shard = shards[key % SHARD_COUNT];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto refill = [&](const Bucket& bucket) {
+        return std::min(static_cast<double>(burst), bucket.tokens + (now - bucket.updated_ns) / 1e9 * rate);
+    };
+
+    auto it = shard.buckets.find(key);
+    if (it == shard.buckets.end()) {
+        // Lleno: se olvida el cliente que lleva más tiempo sin pedir nada, en O(1)
+        if (shard.buckets.size() >= MAX_BUCKETS_PER_SHARD) {
+            shard.buckets.erase(shard.recent.back());
+            shard.recent.pop_back();
+        }
+        shard.recent.push_front(key);
+        it = shard.buckets.emplace(key, Bucket{static_cast<double>(burst), now, shard.recent.begin()}).first;
+    } else {
+        shard.recent.splice(shard.recent.begin(), shard.recent, it->second.recent);
+    }
+    Bucket& bucket = it->second;
+    bucket.tokens = refill(bucket);
+    bucket.updated_ns = now;
+
+    if (bucket.tokens >= 1) {
+        bucket.tokens -= 1;
+        return true;
+    }
+    retry_after = std::max<int64_t>(1, static_cast<int64_t>(std::ceil((1 - bucket.tokens) / rate)));
+    return false;
+}
+
+AdmissionResult Admission::admit(const crow::request& req, AdmissionClass& cls, int64_t& retry_after) {
+    cls = classify(req);
+    if (cls == AdmissionClass::Exempt) return AdmissionResult::Admitted;
+
+    const Config& settings = config();
+    bool write = cls == AdmissionClass::Write;
+    Family& family = families[write ? 1 : 0];
+    retry_after = settings.admission_retry_after;
+
+    // Lecturas o escrituras lentas: el disco está saturado y se frenan las escrituras, nunca las lecturas
+    size_t limit = write ? settings.admission_write_limit : settings.admission_read_limit;
+    if (write && limit > 0) {
+        auto slow = [](const Family& measured, int64_t threshold_ms) {
+            return threshold_ms > 0 && measured.latency_ns.load(std::memory_order_relaxed) > uint64_t(threshold_ms) * 1000000;
+        };
+        if (slow(families[0], settings.admission_read_latency_ms) || slow(families[1], settings.admission_write_latency_ms))
+            limit = std::max<size_t>(1, limit / 4);
+    }
+
+    if (!acquire(family, limit)) {
+        metrics().count(Counter::AdmissionOverloaded);
+        LOG_WARN("Request shed", {"class", className(cls)}, {"in_flight", std::to_string(inFlight(cls))});
+        return AdmissionResult::Overloaded;
+    }
+
+    // El bucket se gasta solo si la petición tiene sitio para correr
+    int64_t rate = write ? settings.admission_write_rate : settings.admission_read_rate;
+    int64_t burst = write ? settings.admission_write_burst : settings.admission_read_burst;
+    if (rate > 0) {
+        // La IP y no X-Session-ID: la cabecera aún no se ha validado y cambiarla daría un bucket nuevo
+        uint64_t key = std::hash<std::string>{}(req.remote_ip_address) * 2 + (write ? 1 : 0);
+        if (!take(key, rate, burst, retry_after)) {
+            family.in_flight.fetch_sub(1, std::memory_order_relaxed);
+            metrics().count(Counter::AdmissionRateLimited);
+            LOG_WARN("Request rate limited", {"class", className(cls)});
+            return AdmissionResult::RateLimited;
+        }
+    }
+    return AdmissionResult::Admitted;
+}
+
+void Admission::release(AdmissionClass cls, std::chrono::steady_clock::duration elapsed) {
+    if (cls == AdmissionClass::Exempt) return;
+    Family& family = families[cls == AdmissionClass::Write ? 1 : 0];
+    family.in_flight.fetch_sub(1, std::memory_order_relaxed);
+
+    // Media móvil exponencial; la primera muestra se toma tal cual
+    int64_t sample = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    uint64_t current = family.latency_ns.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+        next = current == 0 ? sample : current + (sample - static_cast<int64_t>(current)) / LATENCY_SMOOTHING;
+    } while (!family.latency_ns.compare_exchange_weak(current, next, std::memory_order_relaxed));
+}
+
+size_t Admission::inFlight(AdmissionClass cls) const {
+    if (cls == AdmissionClass::Exempt) return 0;
+    return families[cls == AdmissionClass::Write ? 1 : 0].in_flight.load(std::memory_order_relaxed);
+}
+
+double Admission::latencyMs(AdmissionClass cls) const {
+    if (cls == AdmissionClass::Exempt) return 0;
+    return families[cls == AdmissionClass::Write ? 1 : 0].latency_ns.load(std::memory_order_relaxed) / 1e6;
+}
+
+Admission& admission() {
+    static Admission instance;
+    return instance;
+}
+
+void AdmissionMiddleware::before_handle(crow::request& req, crow::response& res, context& ctx) {
+    ctx.start = std::chrono::steady_clock::now();
+    int64_t retry_after = 0;
+    AdmissionResult result = admission().admit(req, ctx.cls, retry_after);
+    if (result == AdmissionResult::Admitted) {
+        ctx.admitted = ctx.cls != AdmissionClass::Exempt;
+        return;
+    }
+
+    // Rechazo inmediato: el handler no llega a correr
+    bool limited = result == AdmissionResult::RateLimited;
+    res.code = limited ? 429 : 503;
+    res.add_header("Retry-After", std::to_string(retry_after));
+    res.write(limited ? "429 Too Many Requests" : "503 Service Unavailable");
+    res.end();
+}
+
+void AdmissionMiddleware::after_handle(crow::request&, crow::response&, context& ctx) {
+    // Se libera una sola vez aunque Crow llame a after_handle de nuevo al completar la respuesta
+    if (!ctx.admitted) return;
+    ctx.admitted = false;
+    admission().release(ctx.cls, std::chrono::steady_clock::now() - ctx.start);
+}
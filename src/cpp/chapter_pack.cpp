@@ -0,0 +1,209 @@
+#include "../chapter_pack.h"
+#include "../env_loader.h"
+#include "../logger.h"
+#include "../path_index.h"
+#include "../storage_layout.h"
+#include "../token_encryption.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <openssl/evp.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static const char MAGIC[8] = {'P', 'D', 'F', 'P', 'A', 'C', 'K', '1'};
+
+struct PackTrailer {
+    uint64_t index_offset;
+    uint32_t count;
+    uint32_t reserved;
+    char magic[8];
+};
+
+static_assert(sizeof(PackEntry) == 80, "PackEntry is part of the file format");
+static_assert(sizeof(PackTrailer) == 24, "PackTrailer is part of the file format");
+
+// ────────────────────────
+//      ChapterPack
+// ────────────────────────
+
+std::shared_ptr<const ChapterPack> ChapterPack::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+
+    std::shared_ptr<ChapterPack> pack(new ChapterPack());
+    pack->pack_path = path;
+    if (fstat(fd, &pack->st) != 0 ||
+        static_cast<size_t>(pack->st.st_size) < sizeof(MAGIC) + sizeof(PackTrailer)) {
+        ::close(fd);
+        LOG_WARN("Malformed chapter pack", {"path", path});
+        return nullptr;
+    }
+
+    // El mapeo sobrevive al descriptor; las páginas se leen del page cache sin copias intermedias
+    pack->map_size = pack->st.st_size;
+    void* map = mmap(nullptr, pack->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        LOG_WARN("Cannot map chapter pack", {"path", path}, {"error", std::strerror(errno)});
+        return nullptr;
+    }
+    pack->map = map;
+
+    const char* base = static_cast<const char*>(map);
+    PackTrailer trailer;
+    std::memcpy(&trailer, base + pack->map_size - sizeof(PackTrailer), sizeof(trailer));
+    uint64_t index_end = pack->map_size - sizeof(PackTrailer);
+    bool valid = std::memcmp(base, MAGIC, sizeof(MAGIC)) == 0 &&
+                 std::memcmp(trailer.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                 trailer.index_offset >= sizeof(MAGIC) && trailer.index_offset % alignof(PackEntry) == 0 &&
+                 trailer.index_offset <= index_end &&
+                 (index_end - trailer.index_offset) == static_cast<uint64_t>(trailer.count) * sizeof(PackEntry);
+    if (valid) {
+        pack->index = reinterpret_cast<const PackEntry*>(base + trailer.index_offset);
+        pack->count = trailer.count;
+        // Ninguna página puede salirse de la zona de datos y el índice tiene que estar ordenado
+        for (size_t i = 0; valid && i < pack->count; ++i) {
+            const PackEntry& entry = pack->index[i];
+            valid = entry.offset >= sizeof(MAGIC) && entry.offset <= trailer.index_offset &&
+                    entry.length <= trailer.index_offset - entry.offset &&
+                    (i == 0 || pack->index[i - 1].page < entry.page);
+        }
+    }
+    if (!valid) {
+        LOG_WARN("Malformed chapter pack", {"path", path});
+        return nullptr;
+    }
+    return pack;
+}
+
+ChapterPack::~ChapterPack() {
+    if (map) munmap(map, map_size);
+}
+
+const PackEntry* ChapterPack::find(int page) const {
+    if (page <= 0) return nullptr;
+    const PackEntry* end = index + count;
+    const PackEntry* it = std::lower_bound(index, end, static_cast<uint32_t>(page),
+                                           [](const PackEntry& entry, uint32_t page) { return entry.page < page; });
+    return it != end && it->page == static_cast<uint32_t>(page) ? it : nullptr;
+}
+
+std::string ChapterPack::contentType(const PackEntry& entry) {
+    return std::string(entry.content_type, strnlen(entry.content_type, sizeof(entry.content_type)));
+}
+
+std::string ChapterPack::hash(const PackEntry& entry) {
+    return toHex(std::vector<unsigned char>(entry.sha256, entry.sha256 + sizeof(entry.sha256)));
+}
+
+// ────────────────────────
+//      ChapterPackWriter
+// ────────────────────────
+
+ChapterPackWriter::ChapterPackWriter(const std::string& path) : writer(path, false) {}
+
+bool ChapterPackWriter::open() {
+    return writer.open() && writer.append(MAGIC, sizeof(MAGIC));
+}
+
+bool ChapterPackWriter::add(int page, const std::string& content_type, const char* data, size_t size) {
+    if (page <= 0 || content_type.size() >= sizeof(PackEntry::content_type)) return false;
+    if (!index.empty() && index.back().page >= static_cast<uint32_t>(page)) return false;
+
+    PackEntry entry{};
+    entry.page = static_cast<uint32_t>(page);
+    entry.offset = writer.size();
+    entry.length = size;
+    std::memcpy(entry.content_type, content_type.data(), content_type.size());
+
+    unsigned int digest_length = 0;
+    EVP_Digest(data, size, entry.sha256, &digest_length, EVP_sha256(), nullptr);
+
+    if (!writer.append(data, size)) return false;
+    index.push_back(entry);
+    return true;
+}
+
+bool ChapterPackWriter::commit() {
+    // El índice se alinea para poder leerlo directamente del mapeo
+    static const char padding[alignof(PackEntry)] = {};
+    size_t misalignment = writer.size() % alignof(PackEntry);
+    if (misalignment && !writer.append(padding, alignof(PackEntry) - misalignment)) return false;
+
+    PackTrailer trailer{};
+    trailer.index_offset = writer.size();
+    trailer.count = static_cast<uint32_t>(index.size());
+    std::memcpy(trailer.magic, MAGIC, sizeof(MAGIC));
+
+    return writer.append(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(PackEntry)) &&
+           writer.append(reinterpret_cast<const char*>(&trailer), sizeof(trailer)) && writer.commit();
+}
+
+// ────────────────────────
+//      ChapterPacks
+// ────────────────────────
+
+ChapterPacks::ChapterPacks(size_t capacity) : shard_capacity(std::max<size_t>(1, capacity / SHARD_COUNT)) {}
+
+ChapterPacks::Shard& ChapterPacks::shardFor(const std::string& path) {
+    return shards[std::hash<std::string>{}(path) % SHARD_COUNT];
+}
+
+std::optional<std::string> ChapterPacks::locate(const std::string& chapter_key) {
+    PathIndex& index = path_index();
+    std::string logical = chapter_key + "/" + ChapterPack::FILE_NAME;
+    std::string extension;
+    if (auto file = index.lookup(PathIndex::keyFor(logical, &extension))) {
+        if (file->extension == extension) return file->path;
+        return std::nullopt;
+    }
+    if (index.authoritative()) return std::nullopt;
+
+    index.countFallback();
+    for (const std::string& path : storage_layout().places(logical)) {
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            index.update(path);
+            return path;
+        }
+    }
+    return std::nullopt;
+}
+
+std::shared_ptr<const ChapterPack> ChapterPacks::mapped(const std::string& path) {
+    Shard& shard = shardFor(path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.packs.find(path);
+    return it == shard.packs.end() ? nullptr : it->second;
+}
+
+std::shared_ptr<const ChapterPack> ChapterPacks::get(const std::string& path) {
+    if (auto pack = mapped(path)) return pack;
+
+    // Se mapea fuera del lock; si dos hilos compiten se queda el primero
+    std::shared_ptr<const ChapterPack> pack = ChapterPack::open(path);
+    if (!pack) return nullptr;
+
+    Shard& shard = shardFor(path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto [it, inserted] = shard.packs.emplace(path, pack);
+    // Lleno: se suelta cualquier otro mapeo, los lectores en curso conservan el suyo
+    if (inserted && shard.packs.size() > shard_capacity) {
+        auto victim = shard.packs.begin();
+        if (victim == it) ++victim;
+        shard.packs.erase(victim);
+    }
+    return it->second;
+}
+
+void ChapterPacks::invalidate(const std::string& path) {
+    Shard& shard = shardFor(path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.packs.erase(path);
+}
+
+ChapterPacks& chapter_packs() {
+    static ChapterPacks packs(static_cast<size_t>(std::max(1LL, env_integer("CHAPTER_PACK_CACHE", 4096))));
+    return packs;
+}
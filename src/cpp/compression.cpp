@@ -0,0 +1,100 @@
+#include "../compression.h"
+#include <cstdlib>
+#include <zlib.h>
+
+#if __has_include(<zstd.h>)
+#include <zstd.h>
+#define PDFAST_HAVE_ZSTD 1
+#endif
+
+bool zstd_available() {
+#ifdef PDFAST_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::string negotiate_encoding(const std::string& accept_encoding) {
+    double zstd_q = -1, gzip_q = -1, any_q = -1;
+
+    size_t pos = 0;
+    while (pos < accept_encoding.size()) {
+        size_t comma = accept_encoding.find(',', pos);
+        if (comma == std::string::npos) comma = accept_encoding.size();
+        std::string item = accept_encoding.substr(pos, comma - pos);
+        pos = comma + 1;
+
+        double q = 1.0;
+        size_t semicolon = item.find(';');
+        if (semicolon != std::string::npos) {
+            size_t q_pos = item.find("q=", semicolon);
+            if (q_pos != std::string::npos) q = std::atof(item.c_str() + q_pos + 2);
+            item.erase(semicolon);
+        }
+
+        size_t start = item.find_first_not_of(" \t");
+        size_t end = item.find_last_not_of(" \t");
+        if (start == std::string::npos) continue;
+        std::string coding = item.substr(start, end - start + 1);
+
+        if (coding == "zstd") zstd_q = q;
+        else if (coding == "gzip" || coding == "x-gzip") gzip_q = q;
+        else if (coding == "*") any_q = q;
+    }
+
+    if (zstd_q < 0) zstd_q = any_q;
+    if (gzip_q < 0) gzip_q = any_q;
+    if (!zstd_available()) zstd_q = -1;
+
+    // En empate se prefiere zstd: comprime más y descomprime más rápido
+    if (zstd_q > 0 && zstd_q >= gzip_q) return "zstd";
+    if (gzip_q > 0) return "gzip";
+    return "";
+}
+
+std::string encoding_suffix(const std::string& encoding) {
+    return encoding == "zstd" ? ".zst" : ".gz";
+}
+
+bool is_compressible(const std::string& content_type) {
+    return content_type.compare(0, 5, "text/") == 0 ||
+           content_type == "application/javascript" ||
+           content_type == "application/json" ||
+           content_type == "image/svg+xml" ||
+           content_type == "font/ttf" ||
+           content_type == "font/otf";
+}
+
+static bool gzipCompress(const std::string& input, std::string& output) {
+    z_stream stream{};
+    // 15 + 16: ventana máxima con cabecera gzip. Nivel rápido: se comprime al vuelo en el pool de E/S,
+    // los niveles máximos son para los sidecars de precompress.sh
+    if (deflateInit2(&stream, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    output.resize(deflateBound(&stream, input.size()));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = reinterpret_cast<Bytef*>(output.data());
+    stream.avail_out = static_cast<uInt>(output.size());
+
+    int result = deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END;
+}
+
+bool compress_buffer(const std::string& encoding, const std::string& input, std::string& output) {
+    if (encoding == "gzip") return gzipCompress(input, output);
+#ifdef PDFAST_HAVE_ZSTD
+    if (encoding == "zstd") {
+        output.resize(ZSTD_compressBound(input.size()));
+        size_t size = ZSTD_compress(output.data(), output.size(), input.data(), input.size(), 3);
+        if (ZSTD_isError(size)) return false;
+        output.resize(size);
+        return true;
+    }
+#endif
+    return false;
+}
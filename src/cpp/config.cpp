@@ -0,0 +1,170 @@
+#include "../config.h"
+#include "../env_loader.h"
+#include "../logger.h"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <limits>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+
+static const char* ENV_FILE = ".env";
+
+static std::atomic<std::shared_ptr<const Config>> current_config;
+static std::atomic<uint64_t> current_version{0};
+static std::atomic<bool> reload_requested{false};
+
+static std::string stringOr(const std::unordered_map<std::string, std::string>& values,
+                            const std::string& name, const std::string& fallback) {
+    auto it = values.find(name);
+    return it == values.end() ? fallback : it->second;
+}
+
+static long long integerOr(const std::unordered_map<std::string, std::string>& values, const std::string& name,
+                           long long fallback, long long min, long long max, std::vector<std::string>& errors) {
+    auto it = values.find(name);
+    if (it == values.end() || it->second.empty()) return fallback;
+
+    size_t parsed = 0;
+    long long value = 0;
+    try {
+        value = std::stoll(it->second, &parsed);
+    } catch (const std::exception&) {
+        parsed = 0;
+    }
+    if (parsed != it->second.size() || value < min || value > max) {
+        errors.push_back("Invalid value for " + name + ": " + it->second);
+        return fallback;
+    }
+    return value;
+}
+
+std::shared_ptr<const Config> parse_config(const std::unordered_map<std::string, std::string>& values,
+                                           std::vector<std::string>& errors) {
+    auto config = std::make_shared<Config>();
+    const long long max = std::numeric_limits<long long>::max();
+
+    config->allowed_hosts = stringOr(values, "ALLOWED_HOSTS", "");
+    config->cors_origin = stringOr(values, "CORS_ORIGIN", "");
+    if (config->allowed_hosts.empty()) errors.push_back("ALLOWED_HOSTS is empty, every request will be rejected");
+
+    config->encryption_key = stringOr(values, "ENCRYPTION_KEY", "");
+    if (config->encryption_key.empty()) errors.push_back("ENCRYPTION_KEY is empty");
+    // Cada ronda AES duplica el tamaño del token: más de 16 no cabe en memoria
+    config->encryption_rounds = static_cast<int>(integerOr(values, "ENCRYPTION_ROUNDS", 1, 1, 16, errors));
+
+    std::string mode = stringOr(values, "TOKEN_DIGEST_MODE", "aes");
+    if (mode != "aes" && mode != "hmac" && !mode.empty()) errors.push_back("Invalid value for TOKEN_DIGEST_MODE: " + mode);
+    config->digest_mode = mode == "hmac" ? TokenDigestMode::Hmac : TokenDigestMode::Aes;
+    config->digest_migrate = integerOr(values, "TOKEN_DIGEST_MIGRATE", 0, 0, 1, errors) != 0;
+
+    config->cache_control_mangas = stringOr(values, "CACHE_CONTROL_MANGAS", "public, max-age=86400");
+    config->cache_control_profiles = stringOr(values, "CACHE_CONTROL_PROFILES", "public, max-age=300, must-revalidate");
+    config->cache_control_posts = stringOr(values, "CACHE_CONTROL_POSTS", "public, max-age=3600");
+    config->cache_control_website = stringOr(values, "CACHE_CONTROL_WEBSITE", "public, max-age=604800");
+
+    config->range_max_bytes = integerOr(values, "RANGE_MAX_BYTES", 8LL * 1024 * 1024, 1, max, errors);
+    config->upload_max_bytes = integerOr(values, "UPLOAD_MAX_BYTES", 256LL * 1024 * 1024, 0, max, errors);
+    config->upload_batch_max_bytes = integerOr(values, "UPLOAD_BATCH_MAX_BYTES", 1024LL * 1024 * 1024, 0, max, errors);
+    config->upload_checksum = integerOr(values, "UPLOAD_CHECKSUM", 0, 0, 1, errors) != 0;
+
+    config->admission_read_limit = integerOr(values, "ADMISSION_READ_LIMIT", 512, 0, max, errors);
+    config->admission_write_limit = integerOr(values, "ADMISSION_WRITE_LIMIT", 32, 0, max, errors);
+    config->admission_read_latency_ms = integerOr(values, "ADMISSION_READ_LATENCY_MS", 250, 0, max, errors);
+    config->admission_write_latency_ms = integerOr(values, "ADMISSION_WRITE_LATENCY_MS", 2000, 0, max, errors);
+    config->admission_read_rate = integerOr(values, "ADMISSION_READ_RATE", 0, 0, max, errors);
+    config->admission_read_burst = integerOr(values, "ADMISSION_READ_BURST", 200, 1, max, errors);
+    config->admission_write_rate = integerOr(values, "ADMISSION_WRITE_RATE", 0, 0, max, errors);
+    config->admission_write_burst = integerOr(values, "ADMISSION_WRITE_BURST", 100, 1, max, errors);
+    config->admission_retry_after = integerOr(values, "ADMISSION_RETRY_AFTER", 1, 1, 3600, errors);
+
+    config->prefetch_window = integerOr(values, "PREFETCH_WINDOW", 3, 0, 64, errors);
+    config->prefetch_host_budget = integerOr(values, "PREFETCH_HOST_BUDGET", 32LL * 1024 * 1024, 0, max, errors);
+    config->prefetch_ttl = integerOr(values, "PREFETCH_TTL", 60, 1, 86400, errors);
+
+    config->metadata_max_resources = integerOr(values, "METADATA_MAX_RESOURCES", 1000, 1, 100000, errors);
+
+    return config;
+}
+
+static std::mutex publish_mutex;
+
+// El puntero se publica antes que la versión: quien ve la versión nueva ve también el snapshot
+static uint64_t publish(std::shared_ptr<const Config> config) {
+    std::lock_guard<std::mutex> lock(publish_mutex);
+    uint64_t version = current_version.load(std::memory_order_relaxed) + 1;
+    current_config.store(std::move(config), std::memory_order_release);
+    current_version.store(version, std::memory_order_release);
+    return version;
+}
+
+const Config& config() {
+    // La primera carga usa las variables leídas al arrancar; los errores no impiden arrancar
+    static const bool initialized = [] {
+        std::vector<std::string> errors;
+        std::shared_ptr<const Config> initial = parse_config(ENV, errors);
+        for (const std::string& error : errors) LOG_ERROR("Invalid configuration", {"error", error});
+        publish(std::move(initial));
+        return true;
+    }();
+    (void)initialized;
+
+    // El puntero compartido solo se toca cuando cambia la versión; el anterior se conserva
+    // para que una referencia obtenida justo antes de la recarga siga siendo válida
+    thread_local std::shared_ptr<const Config> local;
+    thread_local std::shared_ptr<const Config> previous;
+    thread_local uint64_t local_version = 0;
+
+    uint64_t version = current_version.load(std::memory_order_acquire);
+    if (version != local_version) {
+        previous = std::move(local);
+        local = current_config.load(std::memory_order_acquire);
+        local_version = version;
+    }
+    return *local;
+}
+
+bool reload_config() {
+    config();
+    std::vector<std::string> errors;
+    std::shared_ptr<const Config> reloaded = parse_config(load_env_file(ENV_FILE), errors);
+    if (!errors.empty()) {
+        for (const std::string& error : errors) LOG_ERROR("Configuration reload rejected", {"error", error});
+        return false;
+    }
+
+    uint64_t version = publish(std::move(reloaded));
+    LOG_INFO("Configuration reloaded", {"version", std::to_string(version)});
+    return true;
+}
+
+static void requestReload(int) {
+    reload_requested.store(true, std::memory_order_relaxed);
+}
+
+void start_config_watcher() {
+    config();
+    std::signal(SIGHUP, requestReload);
+
+    std::thread([] {
+        // Inodo, tamaño y mtime: detecta tanto ediciones in situ como reemplazos por rename
+        auto fingerprint = [] {
+            struct stat st;
+            if (stat(ENV_FILE, &st) != 0) return std::string();
+            return std::to_string(st.st_ino) + ":" + std::to_string(st.st_size) + ":" +
+                   std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec);
+        };
+
+        std::string last = fingerprint();
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            std::string now = fingerprint();
+            bool changed = !now.empty() && now != last;
+            if (changed || reload_requested.exchange(false, std::memory_order_relaxed)) {
+                last = now;
+                reload_config();
+            }
+        }
+    }).detach();
+}
@@ -0,0 +1,244 @@
+#include "../content_store.h"
+#include "../atomic_file.h"
+#include "../disk_io.h"
+#include "../env_loader.h"
+#include "../logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <filesystem>
+#include <mutex>
+#include <sys/xattr.h>
+#include <thread>
+#include <unistd.h>
+
+static const size_t HASH_LENGTH = 64;
+// El hash viaja con el inodo, así todos sus enlaces lo tienen desde la primera petición
+static const char* HASH_XATTR = "user.pdfast.sha256";
+
+static std::string directoryOf(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+static bool validHash(const std::string& hash) {
+    return hash.size() == HASH_LENGTH &&
+           std::all_of(hash.begin(), hash.end(), [](char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+}
+
+static void tagBlob(const std::string& blob, const std::string& hash) {
+    // Sin xattrs en el sistema de archivos el hash solo se conoce tras el escaneo
+    ::setxattr(blob.c_str(), HASH_XATTR, hash.data(), hash.size(), 0);
+}
+
+static void syncDirectory(const std::string& directory) {
+    int dir_fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+}
+
+ContentStore::ContentStore(bool enabled, int64_t gc_age_seconds)
+    : is_enabled(enabled), gc_age_seconds(gc_age_seconds) {}
+
+std::string ContentStore::blobPath(const std::string& path, const std::string& hash) {
+    // Un almacén por raíz: los hardlinks no cruzan sistemas de archivos y cada raíz puede ser un volumen
+    size_t slash = path.find('/');
+    std::string root = slash == std::string::npos ? "." : path.substr(0, slash);
+    return root + "/.content/" + hash.substr(0, 2) + "/" + hash.substr(2, 2) + "/" + hash;
+}
+
+ContentStore::Shard& ContentStore::shardFor(uint64_t inode) const {
+    return shards[inode % SHARD_COUNT];
+}
+
+void ContentStore::record(const struct stat& st, const std::string& hash) {
+    Shard& shard = shardFor(st.st_ino);
+    std::unique_lock lock(shard.mutex);
+    shard.blobs[st.st_ino] = Blob{static_cast<uint64_t>(st.st_dev), hash};
+}
+
+std::string ContentStore::hashOf(const std::string& path, const struct stat& st) {
+    // Un archivo con un solo enlace no comparte blob
+    if (!is_enabled || st.st_nlink < 2) return "";
+
+    {
+        Shard& shard = shardFor(st.st_ino);
+        std::shared_lock lock(shard.mutex);
+        auto it = shard.blobs.find(st.st_ino);
+        if (it != shard.blobs.end() && it->second.device == static_cast<uint64_t>(st.st_dev)) return it->second.hash;
+    }
+
+    // Inodo aún no visto por el escaneo: el hash está guardado en el propio archivo
+    char value[HASH_LENGTH];
+    ssize_t length = ::getxattr(path.c_str(), HASH_XATTR, value, sizeof(value));
+    if (length != static_cast<ssize_t>(HASH_LENGTH)) return "";
+    std::string hash(value, HASH_LENGTH);
+    if (!validHash(hash)) return "";
+    record(st, hash);
+    return hash;
+}
+
+void ContentStore::store(const std::string& path, const char* data, size_t size, const std::string& hash,
+                         std::function<void(int result)> done) {
+    std::string blob = blobPath(path, hash);
+    auto st = std::make_shared<struct stat>();
+    disk_io().stat(blob, st.get(), [this, path, blob, hash, data, size, done, st](int result) {
+        // El blob ya existe: no se escribe ni un byte
+        if (result == 0 && S_ISREG(st->st_mode)) {
+            link(path, blob, hash, false, data, size, done);
+            return;
+        }
+        writeBlob(path, blob, hash, data, size, done);
+    });
+}
+
+void ContentStore::writeBlob(const std::string& path, const std::string& blob, const std::string& hash,
+                             const char* data, size_t size, std::function<void(int result)> done) {
+    auto linked = [this, path, blob, hash, data, size, done](int result) {
+        if (result < 0) {
+            done(result);
+            return;
+        }
+        link(path, blob, hash, true, data, size, done);
+    };
+
+    // Subidas simultáneas del mismo contenido esperan al primer blob en vez de reemplazarlo con otro inodo
+    {
+        std::lock_guard<std::mutex> lock(writing_mutex);
+        auto it = writing.find(hash);
+        if (it != writing.end()) {
+            it->second.push_back(linked);
+            return;
+        }
+        writing[hash].push_back(linked);
+    }
+
+    disk_io().writeFile(blob, data, size, [this, hash](int result) {
+        std::vector<std::function<void(int result)>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(writing_mutex);
+            waiters = std::move(writing[hash]);
+            writing.erase(hash);
+        }
+        for (auto& waiter : waiters) waiter(result);
+    });
+}
+
+void ContentStore::link(const std::string& path, const std::string& blob, const std::string& hash, bool written,
+                        const char* data, size_t size, std::function<void(int result)> done) {
+    // io_uring no tiene linkat en todos los kernels soportados: se hace en el pool de E/S
+    disk_io().blocking([this, path, blob, hash, written, data, size, done] {
+        std::string temp = atomic_temp_path(path);
+        int result = ::link(blob.c_str(), temp.c_str()) == 0 ? 0 : -errno;
+
+        if (result == -ENOENT) {
+            struct stat blob_st;
+            if (::stat(blob.c_str(), &blob_st) != 0) {
+                // El escaneo borró el blob entre el stat y el link: se vuelve a escribir una vez
+                if (!written) writeBlob(path, blob, hash, data, size, done);
+                else done(result);
+                return;
+            }
+            std::error_code ec;
+            std::filesystem::create_directories(directoryOf(path), ec);
+            result = ::link(blob.c_str(), temp.c_str()) == 0 ? 0 : -errno;
+        }
+
+        // El path se reemplaza con rename, así los lectores ven el archivo anterior o el nuevo
+        if (result == 0 && std::rename(temp.c_str(), path.c_str()) != 0) {
+            result = -errno;
+            ::unlink(temp.c_str());
+        }
+
+        if (result == 0) {
+            syncDirectory(directoryOf(path));
+            // El blob compartido toma la fecha de la subida, así Last-Modified no es anterior al path
+            if (written) tagBlob(blob, hash);
+            else ::utimensat(AT_FDCWD, blob.c_str(), nullptr, 0);
+            struct stat blob_st;
+            if (::stat(blob.c_str(), &blob_st) == 0) record(blob_st, hash);
+        }
+        done(result);
+    });
+}
+
+int ContentStore::adopt(const std::string& path, const std::string& hash) {
+    std::string blob = blobPath(path, hash);
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        // Contenido repetido: el path pasa a enlazar el blob y la copia recién escrita se libera
+        std::string temp = atomic_temp_path(path);
+        if (::link(blob.c_str(), temp.c_str()) == 0) {
+            if (std::rename(temp.c_str(), path.c_str()) != 0) {
+                int result = -errno;
+                ::unlink(temp.c_str());
+                return result;
+            }
+            syncDirectory(directoryOf(path));
+            ::utimensat(AT_FDCWD, blob.c_str(), nullptr, 0);
+            break;
+        }
+        if (errno != ENOENT) return -errno;
+
+        // Contenido nuevo: el archivo escrito se queda como blob
+        std::error_code ec;
+        std::filesystem::create_directories(directoryOf(blob), ec);
+        if (::link(path.c_str(), blob.c_str()) == 0) {
+            tagBlob(blob, hash);
+            syncDirectory(directoryOf(blob));
+            break;
+        }
+        // Otra subida creó el blob entre medias: se enlaza el suyo
+        if (errno != EEXIST || attempt == 1) return -errno;
+    }
+
+    struct stat blob_st;
+    if (::stat(blob.c_str(), &blob_st) == 0) record(blob_st, hash);
+    return 0;
+}
+
+void ContentStore::start(const std::vector<std::string>& roots) {
+    if (!is_enabled) return;
+    std::thread([this, roots] { scan(roots); }).detach();
+}
+
+void ContentStore::scan(const std::vector<std::string>& roots) {
+    time_t now = std::time(nullptr);
+    size_t indexed = 0, removed = 0;
+
+    for (const std::string& root : roots) {
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(root + "/.content", ec)) {
+            std::string path = entry.path().string();
+            std::string name = entry.path().filename().string();
+            struct stat st;
+            if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+            bool old = now - st.st_mtime > gc_age_seconds;
+            bool temporary = name.size() != HASH_LENGTH;
+            // Blobs que ningún path enlaza ya, y temporales de escrituras interrumpidas
+            if (old && (temporary || st.st_nlink == 1)) {
+                if (::unlink(path.c_str()) == 0) ++removed;
+                continue;
+            }
+            if (!temporary) {
+                // Blobs escritos antes de guardar el hash en el inodo
+                if (::getxattr(path.c_str(), HASH_XATTR, nullptr, 0) < 0) tagBlob(path, name);
+                record(st, name);
+                ++indexed;
+            }
+        }
+    }
+
+    LOG_INFO("Content store indexed", {"blobs", std::to_string(indexed)}, {"removed", std::to_string(removed)});
+}
+
+ContentStore& content_store() {
+    static ContentStore store(
+        env_integer("CONTENT_STORE", 0) != 0,
+        std::max(0LL, env_integer("CONTENT_STORE_GC_AGE", 3600)));
+    return store;
+}
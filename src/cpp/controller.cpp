@@ -1,190 +1,1432 @@
 #include "../controller.h"
 #include "../csrf_tokens.h"
 #include "../token_encryption.h"
+#include "../env_loader.h"
+#include "../config.h"
+#include "../file_cache.h"
+#include "../http_range.h"
+#include "../http_conditional.h"
+#include "../path_index.h"
+#include "../atomic_file.h"
+#include "../thread_pool.h"
+#include "../compression.h"
+#include "../image_variants.h"
+#include "../metrics.h"
+#include "../logger.h"
+#include "../disk_io.h"
+#include "../content_store.h"
+#include "../prefetch.h"
+#include "../storage_layout.h"
+#include "../chapter_pack.h"
+#include "crow/multipart.h"
 #include <fstream>
+#include <algorithm>
 #include <filesystem>
 #include <unordered_set>
+#include <mutex>
 #include <unordered_map>
-#include <sw/redis++/redis++.h>
-
-using namespace sw::redis;
+#include <random>
+#include <optional>
+#include <charconv>
+#include <set>
+#include <map>
+#include <limits>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // Configuración
-static const std::unordered_set<std::string> VALID_EXTENSIONS = {
-    "jpg", "jpeg", "png", "webp", "gif", "bmp", "tiff", "mp4"
-};
-
 static const std::unordered_map<int, std::string> MESSAGES = {
     {200, "200 OK"}, 
     {201, "201 Created"}, 
+    {206, "206 Partial Content"},
+    {304, "304 Not Modified"},
     {400, "400 Bad Request"},
     {401, "401 Unauthorized"}, 
     {403, "403 Forbidden: Host not allowed"},
     {404, "404 Not Found"}, 
-    {500, "500 Internal Server Error"}
+    {413, "413 Payload Too Large"},
+    {416, "416 Range Not Satisfiable"},
+    {500, "500 Internal Server Error"},
+    {503, "503 Service Unavailable"}
+};
+
+// ────────────────────────
+//      Helper Functions
+// ────────────────────────
+
+bool isCorrectHost(const crow::request& req) {
+    return req.get_header_value("Host") == config().allowed_hosts;
+}
+
+bool isCorrectOrigin(const crow::request& req) {
+    return req.get_header_value("Origin") == config().cors_origin;
+}
+
+void processCodeHTTP(crow::response& res, int code) {    
+    res.code = code;
+    res.write(MESSAGES.contains(code) ? MESSAGES.at(code) : "Unknown error");
+    res.end();
+}
+
+// Los callbacks de disk_io() y del pool de E/S no pueden bloquear ni tocar la respuesta: terminarla
+// (Crow puede escribirla de forma síncrona) se pasa al hilo de Crow de la conexión
+void onConnection(const crow::request& req, std::function<void()> task) {
+    asio::post(*req.io_context, std::move(task));
+}
+
+// processCodeHTTP desde el pool de E/S
+void postCodeHTTP(const crow::request& req, crow::response& res, int code) {
+    onConnection(req, [&res, code] { processCodeHTTP(res, code); });
+}
+
+bool validateRequest(const crow::request& req, crow::response& res) {
+    if (!isCorrectHost(req)) {
+        processCodeHTTP(res, 403);
+        return false;
+    }
+    return true;
+}
+
+std::string tokenDigest(const std::string& value, TokenDigestMode mode) {
+    PhaseTimer timer(Phase::EncryptToken);
+    const Config& settings = config();
+    return digest_token(value, settings.encryption_key, settings.encryption_rounds, mode);
+}
+
+// Responde el error que corresponde al estado del token; true si la petición puede seguir
+bool acceptToken(crow::response& res, TokenStatus status, const std::string& session_key, const std::string& token_value) {
+    if (status == TokenStatus::NotFound || status == TokenStatus::Mismatch) {
+        LOG_WARN("CSRF token mismatch", {"status", status == TokenStatus::NotFound ? "not_found" : "mismatch"});
+        LOG_DEBUG("CSRF token mismatch", {"session", session_key}, {"token", token_value});
+        processCodeHTTP(res, 401);
+        return false;
+    }
+    
+    if (status == TokenStatus::Expired) {
+        LOG_WARN("Token not found or expired");
+        LOG_DEBUG("Token not found or expired", {"session", session_key}, {"token", token_value});
+        processCodeHTTP(res, 401);
+        return false;
+    }
+    
+    if (status == TokenStatus::Exhausted) {
+        LOG_WARN("Token has no remaining uses");
+        processCodeHTTP(res, 401);
+        return false;
+    }
+    
+    if (status == TokenStatus::Unavailable) {
+        // Redis caído o saturado: el cliente puede reintentar con el mismo token
+        LOG_WARN("Token store unavailable");
+        processCodeHTTP(res, 503);
+        return false;
+    }
+    
+    return true;
+}
+
+// Valida y consume el token sin bloquear el hilo del worker; next corre solo si es válido
+void validateCSRF(const crow::request& req, crow::response& res, std::function<void()> next) {
+    std::string session_id = req.get_header_value("X-Session-ID");
+    std::string csrf_token = req.get_header_value("X-CSRF-Token");
+    
+    if (session_id.empty() || csrf_token.empty()) {
+        processCodeHTTP(res, 400);
+        return;
+    }
+    
+    TokenDigestMode mode = config().digest_mode;
+    bool migrate = config().digest_migrate;
+    std::string encrypted_session_id = tokenDigest(session_id, mode);
+    std::string encrypted_input_token = tokenDigest(csrf_token, mode);
+    
+    // Comparar, verificar usos restantes y decrementar en un solo script de Redis.
+    // La respuesta puede llegar en el hilo de AsyncRedis: se sigue en el hilo de la conexión
+    consume_csrf_token(encrypted_session_id, encrypted_input_token,
+        [&req, &res, session_id, csrf_token, encrypted_session_id, encrypted_input_token, mode, migrate, next](TokenStatus status) {
+            if (status == TokenStatus::NotFound && migrate && mode != TokenDigestMode::Aes) {
+                // Migración: tokens emitidos antes del cambio de modo siguen guardados con AES
+                std::string aes_session_id = tokenDigest(session_id, TokenDigestMode::Aes);
+                std::string aes_input_token = tokenDigest(csrf_token, TokenDigestMode::Aes);
+                consume_csrf_token(aes_session_id, aes_input_token, [&req, &res, aes_session_id, aes_input_token, next](TokenStatus status) {
+                    onConnection(req, [&res, status, aes_session_id, aes_input_token, next] {
+                        if (acceptToken(res, status, aes_session_id, aes_input_token)) next();
+                    });
+                });
+                return;
+            }
+            onConnection(req, [&res, status, encrypted_session_id, encrypted_input_token, next] {
+                if (acceptToken(res, status, encrypted_session_id, encrypted_input_token)) next();
+            });
+        });
+}
+
+// ────────────────────────
+//      File Operations
+// ────────────────────────
+
+std::optional<std::string> resolvePath(const std::string& base_path) {
+    PathIndex& index = path_index();
+    if (auto file = index.lookup(base_path)) {
+        if (VALID_EXTENSIONS.contains(file->extension)) return file->path;
+    } else if (index.authoritative()) {
+        // El índice está completo: la página no existe y no se toca el disco
+        return std::nullopt;
+    }
+
+    index.countFallback();
+    for (const auto& ext : VALID_EXTENSIONS) {
+        // Se prueban los dos layouts: un árbol en migración tiene archivos en ambos
+        for (const std::string& path : storage_layout().places(base_path + "." + ext)) {
+            if (std::filesystem::exists(path)) {
+                index.update(path);
+                return path;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+// La ruta en disco de un archivo lógico con extensión conocida, en cualquiera de los dos layouts
+std::string locatePath(const std::string& logical_path) {
+    std::string extension;
+    PathIndex& index = path_index();
+    auto file = index.lookup(PathIndex::keyFor(logical_path, &extension));
+    if (file && file->extension == extension) return file->path;
+
+    std::vector<std::string> candidates = storage_layout().places(logical_path);
+    if (index.authoritative() || candidates.size() == 1) return candidates.front();
+    index.countFallback();
+    for (const std::string& candidate : candidates) {
+        struct stat st;
+        if (stat(candidate.c_str(), &st) == 0) return candidate;
+    }
+    return candidates.front();
+}
+
+void readResolved(const crow::request& req, crow::response& res, const std::string& base_path, RouteFamily family) {
+    auto respond = [&req, &res, family](const std::optional<std::string>& path) {
+        if (!path) {
+            processCodeHTTP(res, 404);
+            return;
+        }
+        handleFileRead(req, res, *path, family);
+    };
+
+    // Con el índice completo la resolución se hace en memoria; si no, puede sondear el disco
+    if (path_index().authoritative()) {
+        respond(resolvePath(base_path));
+        return;
+    }
+    disk_io().blocking([&req, base_path, respond] {
+        auto path = resolvePath(base_path);
+        onConnection(req, [respond, path] { respond(path); });
+    });
+}
+
+void readLocated(const crow::request& req, crow::response& res, const std::string& logical_path, RouteFamily family) {
+    if (path_index().authoritative()) {
+        handleFileRead(req, res, locatePath(logical_path), family);
+        return;
+    }
+    disk_io().blocking([&req, &res, logical_path, family] {
+        std::string path = locatePath(logical_path);
+        onConnection(req, [&req, &res, path, family] { handleFileRead(req, res, path, family); });
+    });
+}
+
+std::string fileETag(const struct stat& st) {
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%llx-%llx-%llx\"",
+             static_cast<unsigned long long>(st.st_ino),
+             static_cast<unsigned long long>(st.st_size),
+             static_cast<unsigned long long>(st.st_mtim.tv_sec) * 1000000000ULL + st.st_mtim.tv_nsec);
+    return etag;
+}
+
+const std::string& cacheControlFor(RouteFamily family) {
+    static const std::string pending = "no-cache";
+    const Config& settings = config();
+
+    switch (family) {
+        case RouteFamily::Mangas: return settings.cache_control_mangas;
+        case RouteFamily::Profiles: return settings.cache_control_profiles;
+        case RouteFamily::Posts: return settings.cache_control_posts;
+        case RouteFamily::Pending: return pending;
+        default: return settings.cache_control_website;
+    }
+}
+
+bool ifRangeMatches(const crow::request& req, const std::string& etag, time_t last_modified) {
+    std::string if_range = req.get_header_value("If-Range");
+    if (if_range.empty() || if_range == etag) return true;
+
+    // Una fecha solo vale si coincide exactamente con Last-Modified; un ETag débil nunca
+    time_t date;
+    return parse_http_date(if_range, date) && date == last_modified;
+}
+
+std::string randomBoundary() {
+    static const char hex_chars[] = "0123456789abcdef";
+    thread_local std::mt19937_64 gen(std::random_device{}());
+    std::string boundary(24, '0');
+    for (char& c : boundary) c = hex_chars[gen() & 0x0F];
+    return boundary;
+}
+
+void respondRanges(crow::response& res, const std::string& content_type, uintmax_t file_size,
+                   const std::vector<ByteRange>& ranges,
+                   const std::function<void(size_t index, std::string& out)>& append) {
+    std::string body;
+    if (ranges.size() == 1) {
+        append(0, body);
+        res.add_header("Content-Type", content_type);
+        res.add_header("Content-Range", content_range(ranges[0], file_size));
+    } else {
+        std::string boundary = randomBoundary();
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            body += "--" + boundary + "\r\n";
+            body += "Content-Type: " + content_type + "\r\n";
+            body += "Content-Range: " + content_range(ranges[i], file_size) + "\r\n\r\n";
+            append(i, body);
+            body += "\r\n";
+        }
+        body += "--" + boundary + "--\r\n";
+        res.add_header("Content-Type", "multipart/byteranges; boundary=" + boundary);
+    }
+
+    res.code = 206;
+    res.write(body);
+    res.end();
+}
+
+struct RangeReads {
+    std::vector<std::string> parts;
+    std::atomic<size_t> pending{0};
+    std::atomic<bool> failed{false};
+    PhaseTimer timer{Phase::DiskRead};
+};
+
+void sendRanges(const crow::request& req, crow::response& res, const std::string& path,
+                const std::shared_ptr<const CachedFile>& cached, const std::string& content_type,
+                uintmax_t file_size, const std::vector<ByteRange>& ranges) {
+    if (cached) {
+        respondRanges(res, content_type, file_size, ranges, [&](size_t i, std::string& out) {
+            out.append(cached->body, ranges[i].first, ranges[i].length());
+        });
+        return;
+    }
+
+    auto open_timer = std::make_shared<PhaseTimer>(Phase::DiskOpen);
+    disk_io().open(path, O_RDONLY | O_CLOEXEC, 0,
+                   [&req, &res, content_type, file_size, ranges, open_timer](int fd) mutable {
+        open_timer.reset();
+        if (fd < 0) {
+            onConnection(req, [&res] { processCodeHTTP(res, 500); });
+            return;
+        }
+
+        // Todos los rangos se leen a la vez; el último en terminar cierra y responde
+        auto reads = std::make_shared<RangeReads>();
+        reads->parts.resize(ranges.size());
+        reads->pending.store(ranges.size());
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            std::string& part = reads->parts[i];
+            part.resize(ranges[i].length());
+            disk_io().readFully(fd, part.data(), part.size(), ranges[i].first,
+                                [&req, &res, content_type, file_size, ranges, reads, fd, i](int result) {
+                if (result < 0 || static_cast<size_t>(result) != reads->parts[i].size()) reads->failed.store(true);
+                if (reads->pending.fetch_sub(1) != 1) return;
+
+                disk_io().close(fd, [&req, &res, content_type, file_size, ranges, reads](int) {
+                    onConnection(req, [&res, content_type, file_size, ranges, reads] {
+                        if (reads->failed.load()) {
+                            processCodeHTTP(res, 500);
+                            return;
+                        }
+                        respondRanges(res, content_type, file_size, ranges, [&](size_t i, std::string& out) {
+                            out += reads->parts[i];
+                        });
+                    });
+                });
+            });
+        }
+    });
+}
+
+bool answerNotModified(const crow::request& req, crow::response& res, const std::string& etag,
+                       time_t last_modified, RouteFamily family) {
+    // set_header: si la respuesta vuelve a empezar con otro archivo, sus validadores reemplazan a los anteriores
+    res.set_header("ETag", etag);
+    res.set_header("Last-Modified", http_date(last_modified));
+    res.set_header("Cache-Control", cacheControlFor(family));
+
+    // Se responde 304 antes de abrir el archivo
+    if (!is_not_modified(req.get_header_value("If-None-Match"), req.get_header_value("If-Modified-Since"),
+                         etag, last_modified))
+        return false;
+
+    res.code = 304;
+    res.end();
+    return true;
+}
+
+// Los rangos que se sirven de un cuerpo de file_size bytes; Unsatisfiable ya respondió el 416
+RangeResult selectRanges(const crow::request& req, crow::response& res, uintmax_t file_size,
+                         const std::string& etag, time_t last_modified, std::vector<ByteRange>& ranges) {
+    std::string range_header = req.get_header_value("Range");
+    if (range_header.empty() || !ifRangeMatches(req, etag, last_modified)) return RangeResult::Ignored;
+
+    RangeResult result = parse_range_header(range_header, file_size, ranges);
+
+    if (result == RangeResult::Unsatisfiable) {
+        res.add_header("Content-Range", "bytes */" + std::to_string(file_size));
+        processCodeHTTP(res, 416);
+        return result;
+    }
+    if (result != RangeResult::Satisfiable) {
+        ranges.clear();
+        return result;
+    }
+
+    // Varios rangos demasiado grandes: se sirve solo el primero y el cliente pide el resto
+    uintmax_t max_bytes = config().range_max_bytes;
+    uintmax_t total = 0;
+    for (const ByteRange& range : ranges) total += range.length();
+    if (ranges.size() > 1 && total > max_bytes) ranges.resize(1);
+
+    // Solo se recorta un rango abierto ("first-"); uno explícito se sirve tal cual lo pidió el cliente
+    if (ranges.size() == 1 && ranges[0].open_ended && ranges[0].length() > max_bytes)
+        ranges[0].last = ranges[0].first + max_bytes - 1;
+    return result;
+}
+
+bool answerRange(const crow::request& req, crow::response& res, const std::string& path,
+                 const std::shared_ptr<const CachedFile>& cached, const std::string& content_type,
+                 uintmax_t file_size, const std::string& etag, time_t last_modified) {
+    std::vector<ByteRange> ranges;
+    RangeResult result = selectRanges(req, res, file_size, etag, last_modified, ranges);
+    if (result == RangeResult::Ignored) return false;
+    if (result == RangeResult::Unsatisfiable) return true;
+
+    sendRanges(req, res, path, cached, content_type, file_size, ranges);
+    return true;
+}
+
+void loadCachedFile(const std::string& path, const std::string& content_type, const struct stat& st,
+                    const std::string& etag, const std::string& content_hash, uint64_t generation,
+                    std::function<void(std::shared_ptr<const CachedFile>, int result)> done, bool speculative = false) {
+    auto cached = std::make_shared<CachedFile>();
+    cached->content_type = content_type;
+    cached->etag = etag;
+    cached->last_modified = st.st_mtim.tv_sec;
+    auto body = std::make_shared<std::string>(st.st_size, '\0');
+
+    auto timer = std::make_shared<PhaseTimer>(Phase::DiskRead);
+    // Solo se cachea el archivo que describe el stat: el ETag y el tamaño salen de él
+    disk_io().readFile(path, body, [path, cached, body, content_hash, generation, done, timer, speculative](int result) mutable {
+        timer.reset();
+        if (result < 0) {
+            done(nullptr, result);
+            return;
+        }
+        cached->body = std::move(*body);
+        FileCache& cache = hot_file_cache();
+        cache.put(path, cached, generation, speculative);
+        // Un blob nunca cambia: la entrada por hash no necesita invalidarse
+        if (!content_hash.empty()) {
+            std::string key = "#" + content_hash;
+            cache.put(key, cached, cache.generation(key), speculative);
+        }
+        done(cached, result);
+    }, std::make_shared<const struct stat>(st));
+}
+
+void sendCachedBody(const crow::request& req, crow::response& res, const std::string& path,
+                    const std::shared_ptr<const CachedFile>& cached) {
+    res.add_header("Accept-Ranges", "bytes");
+    if (answerRange(req, res, path, cached, cached->content_type, cached->body.size(),
+                    cached->etag, cached->last_modified)) return;
+
+    res.add_header("Content-Type", cached->content_type);
+    res.write(cached->body);
+    res.end();
+}
+
+void sendLargeBody(const crow::request& req, crow::response& res, const std::string& path,
+                   const std::string& content_type, const struct stat& st, const std::string& etag) {
+    res.add_header("Accept-Ranges", "bytes");
+    if (answerRange(req, res, path, nullptr, content_type, st.st_size, etag, st.st_mtim.tv_sec)) return;
+
+    // Archivos grandes: Crow los envía desde disco por bloques sin construir el body.
+    // Se rellena lo mismo que set_static_file_info_unsafe, reutilizando el stat ya hecho
+    res.file_info.path = path;
+    res.file_info.statbuf = st;
+    res.file_info.statResult = 0;
+    res.code = 200;
+    res.set_header("Content-Length", std::to_string(st.st_size));
+    res.set_header("Content-Type", content_type);
+    res.end();
+}
+
+void sendFile(const crow::request& req, crow::response& res, const std::string& path,
+              const std::string& content_type, RouteFamily family);
+
+// Continúa sendFile en el hilo de Crow: un archivo grande se envía desde ahí como cualquier archivo estático
+void respondStat(const crow::request& req, crow::response& res, const std::string& path,
+                 const std::string& content_type, RouteFamily family, const struct stat& st,
+                 uint64_t generation) {
+    // Archivos deduplicados: el hash del contenido es el ETag fuerte
+    std::string content_hash = content_store().hashOf(path, st);
+    std::string etag = content_hash.empty() ? fileETag(st) : "\"" + content_hash + "\"";
+    if (answerNotModified(req, res, etag, st.st_mtim.tv_sec, family)) return;
+
+    FileCache& cache = hot_file_cache();
+    if (!cache.admits(st.st_size)) {
+        sendLargeBody(req, res, path, content_type, st, etag);
+        return;
+    }
+
+    // Otro path con los mismos bytes ya está en caché: se comparte su cuerpo sin leer el disco
+    if (!content_hash.empty()) {
+        std::shared_ptr<const CachedFile> shared = cache.get("#" + content_hash);
+        if (shared && shared->content_type == content_type) {
+            cache.put(path, shared, generation);
+            sendCachedBody(req, res, path, shared);
+            return;
+        }
+    }
+    loadCachedFile(path, content_type, st, etag, content_hash, generation,
+                   [&req, &res, path, content_type, family](std::shared_ptr<const CachedFile> cached, int result) {
+        onConnection(req, [&req, &res, path, content_type, family, cached, result] {
+            // Un re-upload reemplazó el archivo después del stat: se empieza de nuevo con el archivo nuevo
+            if (result == -ESTALE) {
+                sendFile(req, res, path, content_type, family);
+                return;
+            }
+            if (!cached) {
+                processCodeHTTP(res, 500);
+                return;
+            }
+            sendCachedBody(req, res, path, cached);
+        });
+    });
+}
+
+void sendFile(const crow::request& req, crow::response& res, const std::string& path,
+              const std::string& content_type, RouteFamily family) {
+    FileCache& cache = hot_file_cache();
+    if (std::shared_ptr<const CachedFile> cached = cache.get(path)) {
+        if (answerNotModified(req, res, cached->etag, cached->last_modified, family)) return;
+        sendCachedBody(req, res, path, cached);
+        return;
+    }
+
+    // La generación se toma antes de leer para descartar lecturas que compitan con un write.
+    // Desde aquí la respuesta se termina en los callbacks de disk_io(), siempre en el hilo de la conexión
+    uint64_t generation = cache.generation(path);
+    auto st = std::make_shared<struct stat>();
+    auto timer = std::make_shared<PhaseTimer>(Phase::DiskOpen);
+    disk_io().stat(path, st.get(), [&req, &res, path, content_type, family, st, generation, timer](int result) mutable {
+        timer.reset();
+        onConnection(req, [&req, &res, path, content_type, family, st, generation, result] {
+            if (result < 0 || !S_ISREG(st->st_mode)) {
+                processCodeHTTP(res, 404);
+                return;
+            }
+            respondStat(req, res, path, content_type, family, *st, generation);
+        });
+    });
+}
+
+FileCache& compressedCache() {
+    static FileCache cache(
+        static_cast<size_t>(env_integer("COMPRESSION_CACHE_BYTES", 32LL * 1024 * 1024)),
+        static_cast<size_t>(env_integer("COMPRESSION_MAX_BYTES", 4LL * 1024 * 1024)));
+    return cache;
+}
+
+ThreadPool& compressionPool() {
+    static ThreadPool pool(static_cast<size_t>(std::max(1LL, env_integer("COMPRESSION_WORKERS", 2))));
+    return pool;
+}
+
+// La variante comprimida de un asset; done recibe nullptr si se sirve el original sin comprimir
+void compressedVariant(const std::string& path, const struct stat& st, const std::string& content_type,
+                       const std::string& encoding, std::function<void(std::shared_ptr<const CachedFile>)> done) {
+    FileCache& cache = compressedCache();
+    std::string key = path + "#" + encoding;
+
+    // El ETag del original codifica inode, tamaño y mtime: si no coincide la variante está obsoleta
+    std::string etag = fileETag(st);
+    etag.insert(etag.size() - 1, "-" + encoding);
+    std::shared_ptr<const CachedFile> cached = cache.get(key);
+    if (cached && cached->etag == etag) {
+        done(cached);
+        return;
+    }
+    if (!cache.admits(st.st_size)) {
+        done(nullptr);
+        return;
+    }
+
+    // Una sola compresión por variante: mientras tanto las demás peticiones reciben el original sin comprimir
+    static std::mutex compressing_mutex;
+    static std::unordered_set<std::string> compressing;
+    {
+        std::lock_guard<std::mutex> lock(compressing_mutex);
+        if (!compressing.insert(key).second) {
+            done(nullptr);
+            return;
+        }
+    }
+    auto finish = [key, done](std::shared_ptr<const CachedFile> variant) {
+        {
+            std::lock_guard<std::mutex> lock(compressing_mutex);
+            compressing.erase(key);
+        }
+        done(variant);
+    };
+
+    auto variant = std::make_shared<CachedFile>();
+    variant->content_type = content_type;
+    variant->etag = etag;
+    variant->last_modified = st.st_mtim.tv_sec;
+    uint64_t generation = cache.generation(key);
+    auto body = std::make_shared<std::string>(st.st_size, '\0');
+    auto timer = std::make_shared<PhaseTimer>(Phase::DiskRead);
+    disk_io().readFile(path, body, [key, encoding, variant, generation, body, finish, timer](int result) mutable {
+        timer.reset();
+        if (result < 0) {
+            finish(nullptr);
+            return;
+        }
+        // Comprimir ocupa la CPU: se hace en su propio pool para no quitarle hilos a las lecturas de disco
+        compressionPool().post([key, encoding, variant, generation, body, finish] {
+            if (!compress_buffer(encoding, *body, variant->body)) {
+                finish(nullptr);
+                return;
+            }
+            compressedCache().put(key, variant, generation);
+            finish(variant);
+        });
+    }, std::make_shared<const struct stat>(st));
+}
+
+// Lo que se decide para un asset comprimible
+struct AssetChoice {
+    std::string path;                           // El original o su sidecar
+    std::string encoding;                       // Content-Encoding, vacío si va sin comprimir
+    std::shared_ptr<const CachedFile> variant;  // La variante comprimida en memoria, si no hay sidecar
 };
 
+// Hace stat del original y del sidecar: corre en el pool de E/S
+void chooseAsset(const std::string& path, const std::string& content_type, const std::string& encoding,
+                 std::function<void(AssetChoice)> done) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        done({path, "", nullptr});
+        return;
+    }
+
+    // Sidecar generado por precompress.sh; solo vale si no es más antiguo que el original
+    std::string sidecar = path + encoding_suffix(encoding);
+    struct stat sidecar_st;
+    if (stat(sidecar.c_str(), &sidecar_st) == 0 && S_ISREG(sidecar_st.st_mode) &&
+        (sidecar_st.st_mtim.tv_sec > st.st_mtim.tv_sec ||
+         (sidecar_st.st_mtim.tv_sec == st.st_mtim.tv_sec && sidecar_st.st_mtim.tv_nsec >= st.st_mtim.tv_nsec))) {
+        done({sidecar, encoding, nullptr});
+        return;
+    }
+
+    compressedVariant(path, st, content_type, encoding, [path, encoding, done](std::shared_ptr<const CachedFile> variant) {
+        if (variant) done({path, encoding, variant});
+        else done({path, "", nullptr});
+    });
+}
+
+void sendAssetChoice(const crow::request& req, crow::response& res, const AssetChoice& choice,
+                     const std::string& content_type) {
+    if (!choice.encoding.empty()) res.add_header("Content-Encoding", choice.encoding);
+    if (!choice.variant) {
+        sendFile(req, res, choice.path, content_type, RouteFamily::Website);
+        return;
+    }
+
+    const CachedFile& variant = *choice.variant;
+    if (answerNotModified(req, res, variant.etag, variant.last_modified, RouteFamily::Website)) return;
+    res.add_header("Accept-Ranges", "bytes");
+    if (answerRange(req, res, choice.path, choice.variant, content_type, variant.body.size(),
+                    variant.etag, variant.last_modified)) return;
+
+    res.add_header("Content-Type", content_type);
+    res.write(variant.body);
+    res.end();
+}
+
+void sendAsset(const crow::request& req, crow::response& res, const std::string& path,
+               const std::string& content_type) {
+    if (!is_compressible(content_type)) {
+        sendFile(req, res, path, content_type, RouteFamily::Website);
+        return;
+    }
+
+    res.add_header("Vary", "Accept-Encoding");
+    std::string encoding = negotiate_encoding(req.get_header_value("Accept-Encoding"));
+    if (encoding.empty()) {
+        sendFile(req, res, path, content_type, RouteFamily::Website);
+        return;
+    }
+
+    // Los stat del original y del sidecar no se hacen en los workers de Crow
+    disk_io().blocking([&req, &res, path, content_type, encoding] {
+        chooseAsset(path, content_type, encoding, [&req, &res, content_type](AssetChoice choice) {
+            onConnection(req, [&req, &res, content_type, choice] { sendAssetChoice(req, res, choice, content_type); });
+        });
+    });
+}
+
+std::string mimeTypeFor(const std::string& extension) {
+    if (extension == "mp4") return "video/mp4";
+    return "image/" + (extension == "jpg" ? "jpeg" : extension);
+}
+
+void handleFileRead(const crow::request& req, crow::response& res, const std::string& path, RouteFamily family) {
+    std::string extension = path.substr(path.find_last_of(".") + 1);
+
+    // ?size=<px> elige la variante reducida más pequeña que cubra el tamaño pedido
+    const char* size = req.url_params.get("size");
+    if (size && family != RouteFamily::Mangas) {
+        int requested = std::atoi(size);
+        if (requested <= 0) {
+            processCodeHTTP(res, 400);
+            return;
+        }
+        // select() consulta el disco: se decide en el pool de E/S y se responde desde la conexión
+        disk_io().blocking([&req, &res, path, extension, requested, family] {
+            VariantChoice choice = image_variants().select(path, requested);
+            onConnection(req, [&req, &res, path, extension, family, choice] {
+                if (!choice.path.empty()) {
+                    sendFile(req, res, choice.path, mimeTypeFor(extension), family);
+                    return;
+                }
+                // Mientras se genera se sirve el original, pero sin que las cachés lo guarden como la variante
+                sendFile(req, res, path, mimeTypeFor(extension), choice.pending ? RouteFamily::Pending : family);
+            });
+        });
+        return;
+    }
+
+    sendFile(req, res, path, mimeTypeFor(extension), family);
+}
+
+// Carga una página en la caché como entrada especulativa, sin responder a nadie
+void warmCache(const std::string& path) {
+    std::string content_type = mimeTypeFor(path.substr(path.find_last_of(".") + 1));
+    uint64_t generation = hot_file_cache().generation(path);
+    auto st = std::make_shared<struct stat>();
+    disk_io().stat(path, st.get(), [path, content_type, generation, st](int result) {
+        if (result < 0 || !S_ISREG(st->st_mode)) return;
+        std::string content_hash = content_store().hashOf(path, *st);
+        std::string etag = content_hash.empty() ? fileETag(*st) : "\"" + content_hash + "\"";
+        loadCachedFile(path, content_type, *st, etag, content_hash, generation,
+                       [](std::shared_ptr<const CachedFile>, int) {}, true);
+    });
+}
+
+// Calienta las páginas siguientes del capítulo después de despachar la actual
+void prefetchAfter(const std::string& client, const std::string& chapter_key, int page) {
+    for (const PrefetchPage& next : prefetcher().plan(client, chapter_key, page)) {
+        if (next.cache) warmCache(next.path);
+        else disk_io().blocking([path = next.path] { Prefetcher::adviseWillNeed(path); });
+    }
+}
+
+void handleFileWrite(crow::response& res, const crow::request& req, const std::string& logical_path) {
+    if (req.body.size() > config().upload_max_bytes) {
+        processCodeHTTP(res, 413);
+        return;
+    }
+
+    // Verificar integridad antes de tocar el disco
+    std::string expected_sha = req.get_header_value("X-Content-SHA256");
+    std::string sha;
+    if (config().upload_checksum || !expected_sha.empty()) {
+        sha = sha256_hex(req.body.data(), req.body.size());
+        std::transform(expected_sha.begin(), expected_sha.end(), expected_sha.begin(), ::tolower);
+        if (!expected_sha.empty() && sha != expected_sha) {
+            processCodeHTTP(res, 400);
+            return;
+        }
+    }
+
+    // Temporal, bloques en paralelo, fsync y rename; los lectores ven el archivo anterior hasta el rename.
+    // El body pertenece a la conexión y sigue vivo hasta que se termina la respuesta
+    std::vector<std::string> places = storage_layout().places(logical_path);
+    std::string path = places.front();
+    auto timer = std::make_shared<PhaseTimer>(Phase::DiskWrite);
+    auto written = [&req, &res, path, places, sha, timer](int result) mutable {
+        timer.reset();
+        // Índice, variantes y la copia del otro layout tocan el disco: fuera del hilo de completado
+        disk_io().blocking([&req, &res, path, places, sha, result] {
+            if (result < 0) {
+                LOG_WARN("Upload write failed", {"path", path}, {"error", std::strerror(-result)});
+                postCodeHTTP(req, res, 500);
+                return;
+            }
+            hot_file_cache().invalidate(path);
+            path_index().update(path);
+            if (path.rfind("Media/", 0) == 0) image_variants().schedule(path);
+
+            // La copia del otro layout quedaría obsoleta: se borra antes de responder
+            for (size_t i = 1; i < places.size(); ++i) {
+                if (::unlink(places[i].c_str()) != 0) continue;
+                hot_file_cache().invalidate(places[i]);
+                path_index().update(places[i]);
+            }
+            onConnection(req, [&res, sha] {
+                if (!sha.empty()) res.add_header("X-Content-SHA256", sha);
+                processCodeHTTP(res, 201);
+            });
+        });
+    };
+
+    if (content_store().enabled()) {
+        // Con el almacén por contenido el path pasa a ser un hardlink al blob de su hash
+        std::string hash = sha.empty() ? sha256_hex(req.body.data(), req.body.size()) : sha;
+        content_store().store(path, req.body.data(), req.body.size(), hash, written);
+        return;
+    }
+    disk_io().writeFile(path, req.body.data(), req.body.size(), written);
+}
+
+// ────────────────────────
+//      Chapter Bundles
+// ────────────────────────
+
+struct BundlePage {
+    int page;
+    std::string path;
+    std::string content_type;
+    std::string etag;
+    uintmax_t size;
+    std::shared_ptr<const ChapterPack> pack;   // Páginas de un capítulo sellado
+    const PackEntry* entry = nullptr;
+};
+
+std::vector<BundlePage> listChapterPages(const std::string& chapter_dir, int from, int to) {
+    // Durante una migración una página puede estar en los dos layouts: gana la más reciente
+    std::map<int, std::pair<long long, BundlePage>> found;
+    for (const std::string& directory : storage_layout().directories(chapter_dir)) {
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+            std::string extension;
+            std::string name = PathIndex::keyFor(entry.path().filename().string(), &extension);
+            int page = 0;
+            auto [end, parse_ec] = std::from_chars(name.data(), name.data() + name.size(), page);
+            if (parse_ec != std::errc() || end != name.data() + name.size()) continue;
+            if (page < from || page > to || !VALID_EXTENSIONS.contains(extension)) continue;
+
+            struct stat st;
+            std::string path = entry.path().generic_string();
+            if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+            long long mtime = static_cast<long long>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+            auto it = found.find(page);
+            if (it != found.end() && it->second.first >= mtime) continue;
+            found[page] = {mtime, {page, path, mimeTypeFor(extension), fileETag(st), static_cast<uintmax_t>(st.st_size)}};
+        }
+    }
+
+    // Las páginas del capítulo sellado; un archivo suelto subido después tiene prioridad sobre el pack
+    if (auto pack_path = chapter_packs().locate(chapter_dir)) {
+        if (auto pack = chapter_packs().get(*pack_path)) {
+            for (const PackEntry& entry : pack->entries()) {
+                int page = static_cast<int>(entry.page);
+                if (page < from || page > to || found.contains(page)) continue;
+                found[page] = {0, {page, pack->path(), ChapterPack::contentType(entry),
+                                   "\"" + ChapterPack::hash(entry) + "\"", entry.length, pack, &entry}};
+            }
+        }
+    }
+
+    std::vector<BundlePage> pages;
+    for (auto& [page, entry] : found) pages.push_back(std::move(entry.second));
+    return pages;
+}
+
+bool buildChapterBundle(const std::vector<BundlePage>& pages, const std::string& bundle_path,
+                        const std::string& url_prefix, const std::string& boundary) {
+    AtomicFileWriter writer(bundle_path, false);
+    if (!writer.open()) return false;
+
+    for (const BundlePage& page : pages) {
+        std::string headers = "--" + boundary + "\r\n" +
+            "Content-Type: " + page.content_type + "\r\n" +
+            "Content-Length: " + std::to_string(page.size) + "\r\n" +
+            "Content-Location: " + url_prefix + std::to_string(page.page) + "\r\n" +
+            "ETag: " + page.etag + "\r\n\r\n";
+        if (!writer.append(headers.data(), headers.size())) return false;
+        bool body = page.pack ? writer.append(page.pack->bytes(*page.entry), page.size) : writer.appendFile(page.path);
+        if (!body || !writer.append("\r\n", 2)) return false;
+    }
+
+    std::string closing = "--" + boundary + "--\r\n";
+    return writer.append(closing.data(), closing.size()) && writer.commit();
+}
+
+// Corre en el pool de E/S; la respuesta se termina en el hilo de la conexión
+void handleChapterBundle(const crow::request& req, crow::response& res, const std::string& user,
+                         const std::string& slug, int chapter) {
+    std::string slug_dir = "Mangas/" + user + "/" + slug;
+    std::string chapter_dir = slug_dir + "/" + std::to_string(chapter);
+
+    int from = 1, to = std::numeric_limits<int>::max();
+    if (const char* value = req.url_params.get("from")) from = std::atoi(value);
+    if (const char* value = req.url_params.get("to")) to = std::atoi(value);
+    if (from <= 0 || to < from) {
+        postCodeHTTP(req, res, 400);
+        return;
+    }
+
+    // Cada write renombra dentro del directorio y cambia su mtime; un capítulo nuevo cambia su inodo.
+    // En plena migración el capítulo puede estar en los dos layouts y la versión cubre ambos
+    unsigned long long inode = 0, stamp = 0;
+    bool exists = false;
+    for (const std::string& directory : storage_layout().directories(chapter_dir)) {
+        struct stat dir_stat;
+        if (stat(directory.c_str(), &dir_stat) != 0 || !S_ISDIR(dir_stat.st_mode)) continue;
+        exists = true;
+        inode = inode * 31 + static_cast<unsigned long long>(dir_stat.st_ino);
+        stamp += static_cast<unsigned long long>(dir_stat.st_mtim.tv_sec) * 1000000000ULL + dir_stat.st_mtim.tv_nsec;
+    }
+    if (!exists) {
+        postCodeHTTP(req, res, 404);
+        return;
+    }
+    char version[64];
+    snprintf(version, sizeof(version), "%llx-%llx", inode, stamp);
+
+    std::string bundle_prefix = std::to_string(chapter) + "-" + std::to_string(from) + "-" + std::to_string(to) + "-";
+    std::string bundle_dir = storage_layout().directory(slug_dir) + "/.bundles";
+    std::string bundle_path = bundle_dir + "/" + bundle_prefix + version + ".multipart";
+    std::string boundary = "pdfast-bundle-" + std::string(version);
+
+    std::error_code ec;
+    if (!std::filesystem::exists(bundle_path, ec)) {
+        std::vector<BundlePage> pages = listChapterPages(chapter_dir, from, to);
+        if (pages.empty()) {
+            postCodeHTTP(req, res, 404);
+            return;
+        }
+
+        std::filesystem::create_directories(bundle_dir, ec);
+        std::string url_prefix = "/" + chapter_dir + "/";
+        if (!buildChapterBundle(pages, bundle_path, url_prefix, boundary)) {
+            postCodeHTTP(req, res, 500);
+            return;
+        }
+
+        // Se borran las versiones anteriores del mismo rango
+        for (const auto& entry : std::filesystem::directory_iterator(bundle_dir, ec)) {
+            std::string name = entry.path().filename().string();
+            if (name.compare(0, bundle_prefix.size(), bundle_prefix) == 0 && entry.path() != bundle_path) {
+                hot_file_cache().invalidate(entry.path().generic_string());
+                std::filesystem::remove(entry.path(), ec);
+            }
+        }
+    }
+
+    onConnection(req, [&req, &res, bundle_path, boundary] {
+        sendFile(req, res, bundle_path, "multipart/mixed; boundary=" + boundary, RouteFamily::Mangas);
+    });
+}
+
+// ────────────────────────
+//      Chapter Packs
+// ────────────────────────
+
+// Sirve una página desde el pack mapeado; el ETag es el SHA-256 guardado en el índice.
+// Los bytes se copian del mapeo directamente al body, sin duplicar la página en la caché
+void sendPackedPage(const crow::request& req, crow::response& res, const std::shared_ptr<const ChapterPack>& pack,
+                    int page) {
+    const PackEntry* entry = pack->find(page);
+    if (!entry) {
+        processCodeHTTP(res, 404);
+        return;
+    }
+    std::string etag = "\"" + ChapterPack::hash(*entry) + "\"";
+    time_t last_modified = pack->status().st_mtim.tv_sec;
+    if (answerNotModified(req, res, etag, last_modified, RouteFamily::Mangas)) return;
+
+    res.add_header("Accept-Ranges", "bytes");
+    std::vector<ByteRange> ranges;
+    RangeResult result = selectRanges(req, res, entry->length, etag, last_modified, ranges);
+    if (result == RangeResult::Unsatisfiable) return;
+
+    // Tocar el mapeo puede provocar lecturas de disco: se copian en el pool de E/S solo los bytes que se envían
+    std::string content_type = ChapterPack::contentType(*entry);
+    disk_io().blocking([&req, &res, pack, entry, content_type, ranges] {
+        const char* bytes = pack->bytes(*entry);
+        auto parts = std::make_shared<std::vector<std::string>>();
+        {
+            PhaseTimer timer(Phase::DiskRead);
+            if (ranges.empty()) parts->emplace_back(bytes, entry->length);
+            for (const ByteRange& range : ranges) parts->emplace_back(bytes + range.first, range.length());
+        }
+
+        onConnection(req, [&res, pack, entry, content_type, ranges, parts] {
+            if (!ranges.empty()) {
+                respondRanges(res, content_type, entry->length, ranges, [&](size_t i, std::string& out) {
+                    out += (*parts)[i];
+                });
+                return;
+            }
+            res.add_header("Content-Type", content_type);
+            res.body = std::move(parts->front());
+            res.end();
+        });
+    });
+}
+
+// Una página de un pack que puede no estar mapeado todavía; mapearlo lee el disco
+void sendPackPage(const crow::request& req, crow::response& res, const std::string& pack_path, int page) {
+    if (auto pack = chapter_packs().mapped(pack_path)) {
+        sendPackedPage(req, res, pack, page);
+        return;
+    }
+    disk_io().blocking([&req, &res, pack_path, page] {
+        auto pack = chapter_packs().get(pack_path);
+        onConnection(req, [&req, &res, pack, page] {
+            if (!pack) {
+                processCodeHTTP(res, 500);
+                return;
+            }
+            sendPackedPage(req, res, pack, page);
+        });
+    });
+}
+
+// Una página de manga: primero los archivos sueltos y, si no hay, el pack del capítulo sellado
+void readMangaPage(const crow::request& req, crow::response& res, const std::string& chapter_key, int page) {
+    std::string base_path = chapter_key + "/" + std::to_string(page);
+    auto respond = [&req, &res, page](const std::optional<std::string>& path, const std::optional<std::string>& pack_path) {
+        if (path) handleFileRead(req, res, *path, RouteFamily::Mangas);
+        else if (pack_path) sendPackPage(req, res, *pack_path, page);
+        else processCodeHTTP(res, 404);
+    };
+
+    if (path_index().authoritative()) {
+        auto path = resolvePath(base_path);
+        respond(path, path ? std::nullopt : chapter_packs().locate(chapter_key));
+        return;
+    }
+    disk_io().blocking([&req, chapter_key, base_path, respond] {
+        auto path = resolvePath(base_path);
+        auto pack_path = path ? std::nullopt : chapter_packs().locate(chapter_key);
+        onConnection(req, [respond, path, pack_path] { respond(path, pack_path); });
+    });
+}
+
+// Corre en el pool de E/S; la respuesta se termina en el hilo de la conexión
+void handleChapterSeal(const crow::request& req, crow::response& res, const std::string& chapter_dir, int chapter) {
+    std::vector<BundlePage> pages = listChapterPages(chapter_dir, 1, std::numeric_limits<int>::max());
+    if (pages.empty()) {
+        postCodeHTTP(req, res, 404);
+        return;
+    }
+
+    // Volver a sellar incluye las páginas del pack anterior y las subidas después
+    std::string directory = storage_layout().directory(chapter_dir);
+    std::string pack_path = directory + "/" + ChapterPack::FILE_NAME;
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+
+    ChapterPackWriter writer(pack_path);
+    bool ok = writer.open();
+    std::string body;
+    for (const BundlePage& page : pages) {
+        if (!ok) break;
+        if (page.pack) {
+            ok = writer.add(page.page, page.content_type, page.pack->bytes(*page.entry), page.size);
+            continue;
+        }
+        PhaseTimer timer(Phase::DiskRead);
+        std::ifstream file(page.path, std::ios::binary);
+        body.assign(page.size, '\0');
+        ok = file.read(body.data(), body.size()) && writer.add(page.page, page.content_type, body.data(), body.size());
+    }
+    if (!ok || !writer.commit()) {
+        LOG_WARN("Chapter seal failed", {"path", pack_path});
+        postCodeHTTP(req, res, 500);
+        return;
+    }
+    chapter_packs().invalidate(pack_path);
+    path_index().update(pack_path);
+
+    // Los archivos sueltos ya están en el pack; uno que cambió mientras se sellaba se queda y tiene prioridad
+    for (const BundlePage& page : pages) {
+        struct stat st;
+        if (page.pack || stat(page.path.c_str(), &st) != 0 || fileETag(st) != page.etag) continue;
+        if (::unlink(page.path.c_str()) != 0) continue;
+        hot_file_cache().invalidate(page.path);
+        path_index().update(page.path);
+    }
+    // El capítulo en el otro layout queda sustituido por el pack nuevo
+    std::vector<std::string> directories = storage_layout().directories(chapter_dir);
+    for (size_t i = 1; i < directories.size(); ++i) {
+        std::string old_pack = directories[i] + "/" + ChapterPack::FILE_NAME;
+        if (::unlink(old_pack.c_str()) == 0) {
+            chapter_packs().invalidate(old_pack);
+            path_index().update(old_pack);
+        }
+        std::filesystem::remove(directories[i], ec);
+    }
+
+    struct stat pack_stat;
+    crow::json::wvalue response;
+    response["chapter"] = chapter;
+    response["pages"] = pages.size();
+    response["bytes"] = stat(pack_path.c_str(), &pack_stat) == 0 ? static_cast<uint64_t>(pack_stat.st_size) : 0;
+    onConnection(req, [&res, body = response.dump()] {
+        res.add_header("Content-Type", "application/json");
+        res.write(body);
+        res.end();
+    });
+}
+
 // ────────────────────────
-//      Helper Functions
+//      Chapter Uploads
 // ────────────────────────
 
-bool isCorrectHost(const crow::request& req) {
-    return req.get_header_value("Host") == ENV["ALLOWED_HOSTS"];
-}
+struct PageUpload {
+    std::string name;
+    int page = 0;
+    std::string extension;
+    const std::string* body = nullptr;
+    int status = 201;
+    std::string error;
+};
 
-bool isCorrectOrigin(const crow::request& req) {
-    return req.get_header_value("Origin") == ENV["CORS_ORIGIN"];
+ThreadPool& uploadPool() {
+    static ThreadPool pool(static_cast<size_t>(std::max(1LL, env_integer("UPLOAD_WORKERS", 4))));
+    return pool;
 }
 
-void processCodeHTTP(crow::response& res, int code) {    
-    res.code = code;
-    res.write(MESSAGES.contains(code) ? MESSAGES.at(code) : "Unknown error");
-    res.end();
+void respondChapter(const crow::request& req, crow::response& res, int code, int chapter,
+                    const std::vector<PageUpload>& pages) {
+    std::vector<crow::json::wvalue> statuses;
+    for (const PageUpload& page : pages) {
+        crow::json::wvalue status;
+        status["part"] = page.name;
+        status["page"] = page.page;
+        status["status"] = page.status;
+        if (!page.error.empty()) status["error"] = page.error;
+        statuses.push_back(std::move(status));
+    }
+
+    crow::json::wvalue body;
+    body["chapter"] = chapter;
+    body["published"] = code == 201;
+    body["pages"] = std::move(statuses);
+
+    onConnection(req, [&res, code, body = body.dump()] {
+        res.code = code;
+        res.add_header("Content-Type", "application/json");
+        res.write(body);
+        res.end();
+    });
 }
 
-bool validateRequest(const crow::request& req, crow::response& res) {
-    if (!isCorrectHost(req)) {
-        processCodeHTTP(res, 403);
-        return false;
+bool parsePageUploads(const crow::multipart::message& message, std::vector<PageUpload>& pages) {
+    bool valid = true;
+    std::set<int> seen;
+
+    for (const auto& part : message.parts) {
+        PageUpload upload;
+        const auto& disposition = part.get_header_object("Content-Disposition");
+        auto name = disposition.params.find("name");
+        if (name != disposition.params.end()) upload.name = name->second;
+
+        // El nombre del part es el número de página
+        auto [end, ec] = std::from_chars(upload.name.data(), upload.name.data() + upload.name.size(), upload.page);
+        std::string content_type = part.get_header_object("Content-Type").value;
+        upload.extension = content_type.substr(content_type.find('/') + 1);
+
+        if (ec != std::errc() || end != upload.name.data() + upload.name.size() || upload.page <= 0) {
+            upload.status = 400;
+            upload.error = "part name must be a positive page number";
+        } else if (!seen.insert(upload.page).second) {
+            upload.status = 400;
+            upload.error = "duplicated page";
+        } else if (content_type.find("image/") != 0 || !VALID_EXTENSIONS.contains(upload.extension)) {
+            upload.status = 400;
+            upload.error = "unsupported Content-Type";
+        } else if (part.body.size() > config().upload_max_bytes) {
+            upload.status = 413;
+            upload.error = "page too large";
+        }
+
+        upload.body = &part.body;
+        valid = valid && upload.status == 201;
+        pages.push_back(std::move(upload));
     }
-    return true;
+    return valid && !pages.empty();
 }
 
-bool validateCSRF(const crow::request& req, crow::response& res) {
-    std::string session_id = req.get_header_value("X-Session-ID");
-    std::string csrf_token = req.get_header_value("X-CSRF-Token");
-    
-    if (session_id.empty() || csrf_token.empty()) {
-        processCodeHTTP(res, 400);
-        return false;
+// Corre en el pool de E/S; la respuesta se termina en el hilo de la conexión
+void handleChapterUpload(const crow::request& req, crow::response& res, const std::string& slug_dir, int chapter) {
+    if (req.body.size() > config().upload_batch_max_bytes) {
+        postCodeHTTP(req, res, 413);
+        return;
     }
-    
-    std::string salt = ENV["ENCRYPTION_KEY"];
-    int rounds = std::stoi(ENV["ENCRYPTION_ROUNDS"]);
-    std::string encrypted_session_id = encrypt_token(session_id, salt, rounds);
-    
-    // Verificar token CSRF
-    auto encrypted_csrf_token = redis.get("csrf_token:" + encrypted_session_id);
-    std::string encrypted_input_token = encrypt_token(csrf_token, salt, rounds);
-    
-    if (!encrypted_csrf_token || *encrypted_csrf_token != encrypted_input_token) {
-        std::cout << "CSRF token mismatch." << std::endl;
-        std::cout << "Encrypted Session ID: " << encrypted_session_id << std::endl;
-        std::cout << "Encrypted CSRF Token: " << encrypted_input_token << std::endl;
-        std::cout << "Stored CSRF Token: " << (encrypted_csrf_token ? *encrypted_csrf_token : "null");
-        std::cout << std::endl;
-        processCodeHTTP(res, 401);
-        return false;
+    if (req.get_header_value("Content-Type").find("multipart/form-data") == std::string::npos) {
+        postCodeHTTP(req, res, 400);
+        return;
     }
-    
-    // Verificar usos restantes
-    auto remaining_uses = redis.get("token_uses:" + encrypted_session_id);
-    if (!remaining_uses) {
-        std::cout << "Token not found or expired." << std::endl;
-        std::cout << "Encrypted Session ID: " << encrypted_session_id << std::endl;
-        std::cout << "Encrypted CSRF Token: " << encrypted_input_token << std::endl;
-        
-        processCodeHTTP(res, 401);
-        return false;
+
+    crow::multipart::message message(req);
+    std::vector<PageUpload> pages;
+    if (!parsePageUploads(message, pages)) {
+        respondChapter(req, res, 400, chapter, pages);
+        return;
     }
-    
-    int uses = std::stoi(*remaining_uses);
-    if (uses <= 0) {
-        std::cout << "Token has no remaining uses." << std::endl;
-        processCodeHTTP(res, 401);
-        return false;
+
+    // Las páginas se escriben en un directorio oculto y se publican juntas con un rename
+    std::vector<std::string> directories = storage_layout().directories(slug_dir + "/" + std::to_string(chapter));
+    std::string target = directories.front();
+    std::string staging = target.substr(0, target.find_last_of('/')) + "/." + std::to_string(chapter) +
+                          ".staging-" + randomBoundary();
+    std::error_code ec;
+    std::filesystem::create_directories(staging, ec);
+    if (ec) {
+        postCodeHTTP(req, res, 500);
+        return;
     }
-    
-    // Decrementar contador de usos
-    redis.decr("token_uses:" + encrypted_session_id);
-    
-    return true;
+
+    std::vector<std::future<void>> writes;
+    for (PageUpload& page : pages) {
+        writes.push_back(uploadPool().submit([&page, &staging] {
+            PhaseTimer timer(Phase::DiskWrite);
+            std::string path = staging + "/" + std::to_string(page.page) + "." + page.extension;
+            bool deduplicate = content_store().enabled();
+            AtomicFileWriter writer(path, deduplicate);
+            bool ok = writer.open();
+            const size_t chunk_size = 64 * 1024;
+            for (size_t offset = 0; ok && offset < page.body->size(); offset += chunk_size)
+                ok = writer.append(page.body->data() + offset, std::min(chunk_size, page.body->size() - offset));
+            ok = ok && writer.commit();
+            // El hardlink sobrevive al rename del directorio de staging, así el capítulo comparte blobs
+            if (ok && deduplicate) ok = content_store().adopt(path, writer.sha256()) == 0;
+            if (!ok) {
+                page.status = 500;
+                page.error = "write failed";
+            }
+        }));
+    }
+    for (auto& write : writes) write.wait();
+
+    bool written = std::all_of(pages.begin(), pages.end(), [](const PageUpload& page) { return page.status == 201; });
+    std::vector<std::string> old_files;
+    for (const std::string& directory : directories)
+        for (const auto& entry : std::filesystem::directory_iterator(directory, ec))
+            old_files.push_back(entry.path().generic_string());
+
+    if (!written || !replace_directory(staging, target)) {
+        std::filesystem::remove_all(staging, ec);
+        respondChapter(req, res, 500, chapter, pages);
+        return;
+    }
+    // El capítulo publicado reemplaza también la copia del otro layout
+    for (size_t i = 1; i < directories.size(); ++i) std::filesystem::remove_all(directories[i], ec);
+
+    for (const std::string& path : old_files) {
+        hot_file_cache().invalidate(path);
+        chapter_packs().invalidate(path);
+        path_index().update(path);
+    }
+    for (const PageUpload& page : pages) {
+        std::string path = target + "/" + std::to_string(page.page) + "." + page.extension;
+        hot_file_cache().invalidate(path);
+        path_index().update(path);
+    }
+
+    respondChapter(req, res, 201, chapter, pages);
 }
 
 // ────────────────────────
-//      File Operations
+//      Metadata
 // ────────────────────────
 
-void handleFileRead(crow::response& res, const std::string& path) {
-    if (!std::filesystem::exists(path)) {
-        processCodeHTTP(res, 404);
+struct ResourceMetadata {
+    std::string resource;
+    std::string error;
+    std::string path;                          // El archivo que serviría el GET, vacío si no hay
+    std::shared_ptr<const ChapterPack> pack;   // O la página empaquetada
+    const PackEntry* entry = nullptr;
+    struct stat st{};
+    bool exists = false;
+};
+
+bool parsePositive(const std::string& value, int& number) {
+    auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), number);
+    return ec == std::errc() && end == value.data() + value.size() && number > 0;
+}
+
+// Resuelve la URL de un GET igual que su handler, sin leer el archivo
+void resolveResource(ResourceMetadata& item) {
+    std::vector<std::string> parts;
+    for (size_t start = 1, end; start <= item.resource.size(); start = end + 1) {
+        end = item.resource.find('/', start);
+        if (end == std::string::npos) end = item.resource.size();
+        parts.push_back(item.resource.substr(start, end - start));
+    }
+    bool valid = !item.resource.empty() && item.resource[0] == '/' &&
+                 std::none_of(parts.begin(), parts.end(), [](const std::string& part) {
+                     return part.empty() || part[0] == '.';
+                 });
+    int chapter = 0, page = 0;
+
+    if (valid && parts.size() == 5 && parts[0] == "Mangas" && parsePositive(parts[3], chapter) &&
+        parsePositive(parts[4], page)) {
+        std::string chapter_key = "Mangas/" + parts[1] + "/" + parts[2] + "/" + parts[3];
+        if (auto path = resolvePath(chapter_key + "/" + parts[4])) {
+            item.path = *path;
+        } else if (auto pack_path = chapter_packs().locate(chapter_key)) {
+            item.pack = chapter_packs().get(*pack_path);
+            if (item.pack) item.entry = item.pack->find(page);
+        }
         return;
     }
-    
-    std::string extension = path.substr(path.find_last_of(".") + 1);
-    std::string mime_type = "image/" + (extension == "jpg" ? "jpeg" : extension);
-    
-    std::ifstream file(path, std::ios::binary);
-    if (!file) {
-        processCodeHTTP(res, 500);
+    if (valid && parts.size() == 6 && parts[0] == "Media" && parts[1] == "Profiles" &&
+        (parts[3] == "Posts" || parts[3] == "Groups") && parsePositive(parts[5], page)) {
+        if (auto path = resolvePath("Media/" + parts[2] + "/" + parts[3] + "/" + parts[4] + "/" + parts[5]))
+            item.path = *path;
         return;
     }
-    
-    res.add_header("Content-Type", mime_type);
-    const size_t buffer_size = 8192;
-    char buffer[buffer_size];
-    
-    while (file.read(buffer, buffer_size) || file.gcount() > 0) {
-        res.write(std::string(buffer, file.gcount()));
+    if (valid && parts.size() == 4 && parts[0] == "Media" && parts[1] == "Profiles") {
+        size_t dot = parts[3].find_last_of('.');
+        std::string name = parts[3].substr(0, dot);
+        if (dot == std::string::npos) {
+            if (auto path = resolvePath("Media/" + parts[2] + "/" + name)) item.path = *path;
+        } else if (name != "profilepicture" && name != "bannerpicture") {
+            item.error = "unknown resource";
+        } else if (VALID_EXTENSIONS.contains(parts[3].substr(dot + 1))) {
+            item.path = locatePath("Media/" + parts[2] + "/" + parts[3]);
+        } else {
+            item.error = "unsupported extension";
+        }
+        return;
     }
-    
-    file.close();
-    res.end();
+    item.error = "unknown resource";
 }
 
-void handleFileWrite(crow::response& res, const crow::request& req, const std::string& path) {
-    try {
-        // Crear directorios padres si no existen
-        std::filesystem::path file_path(path);
-        std::filesystem::path dir_path = file_path.parent_path();
-        
-        if (!dir_path.empty() && !std::filesystem::exists(dir_path)) {
-            if (!std::filesystem::create_directories(dir_path)) {
-                processCodeHTTP(res, 500);
-                return;
-            }
-        }
+void respondMetadata(crow::response& res, const std::vector<ResourceMetadata>& items) {
+    std::vector<crow::json::wvalue> resources;
+    resources.reserve(items.size());
+    for (const ResourceMetadata& item : items) {
+        crow::json::wvalue value;
+        value["resource"] = item.resource;
+        if (!item.error.empty()) value["error"] = item.error;
+        value["exists"] = item.exists || item.entry != nullptr;
 
-        // Escribir archivo
-        std::ofstream file(file_path, std::ios::binary);
-        if (!file.is_open()) {
-            processCodeHTTP(res, 500);
-            return;
-        }
-        
-        file.write(req.body.data(), req.body.size());
-        file.close();
-
-        // Verificar integridad del archivo
-        if (!std::filesystem::exists(file_path) || 
-            std::filesystem::file_size(file_path) != req.body.size()) {
-            std::filesystem::remove(file_path);
-            processCodeHTTP(res, 500);
-            return;
+        if (item.entry) {
+            std::string content_type = ChapterPack::contentType(*item.entry);
+            value["extension"] = content_type.substr(content_type.find('/') + 1);
+            value["content_type"] = content_type;
+            value["size"] = item.entry->length;
+            value["mtime"] = static_cast<int64_t>(item.pack->status().st_mtim.tv_sec);
+            value["etag"] = "\"" + ChapterPack::hash(*item.entry) + "\"";
+            value["packed"] = true;
+        } else if (item.exists) {
+            // El mismo ETag que enviaría el GET, incluido el de los archivos deduplicados
+            std::string extension = item.path.substr(item.path.find_last_of('.') + 1);
+            std::string content_hash = content_store().hashOf(item.path, item.st);
+            value["extension"] = extension;
+            value["content_type"] = mimeTypeFor(extension);
+            value["size"] = static_cast<uint64_t>(item.st.st_size);
+            value["mtime"] = static_cast<int64_t>(item.st.st_mtim.tv_sec);
+            value["etag"] = content_hash.empty() ? fileETag(item.st) : "\"" + content_hash + "\"";
         }
+        resources.push_back(std::move(value));
+    }
+
+    crow::json::wvalue body;
+    body["resources"] = std::move(resources);
+    res.add_header("Content-Type", "application/json");
+    res.write(body.dump());
+    res.end();
+}
+
+void handleMetadata(const crow::request& req, crow::response& res) {
+    crow::json::rvalue body = crow::json::load(req.body);
+    if (!body || body.t() != crow::json::type::Object || !body.has("resources") ||
+        body["resources"].t() != crow::json::type::List) {
+        processCodeHTTP(res, 400);
+        return;
+    }
+    if (body["resources"].size() > config().metadata_max_resources) {
+        processCodeHTTP(res, 413);
+        return;
+    }
 
-        processCodeHTTP(res, 201);
-    } 
-    catch (const std::exception& e) {
-        // Loggear el error si es necesario
-        processCodeHTTP(res, 500);
+    auto items = std::make_shared<std::vector<ResourceMetadata>>(body["resources"].size());
+    for (size_t i = 0; i < items->size(); ++i) {
+        const crow::json::rvalue& resource = body["resources"][i];
+        if (resource.t() == crow::json::type::String) (*items)[i].resource = std::string(resource.s());
+        else (*items)[i].error = "resource must be a string";
     }
+
+    // Resolver puede sondear el disco o mapear packs: se hace en el pool de E/S
+    disk_io().blocking([&req, &res, items] {
+        for (ResourceMetadata& item : *items)
+            if (item.error.empty()) resolveResource(item);
+
+        // Todos los stat se encolan a la vez y el último en terminar responde
+        auto pending = std::make_shared<std::atomic<size_t>>(1);
+        auto timer = std::make_shared<PhaseTimer>(Phase::DiskOpen);
+        auto finish = [&req, &res, items, pending, timer]() mutable {
+            if (pending->fetch_sub(1) != 1) return;
+            timer.reset();
+            // Serializar cientos de entradas no se hace en el hilo de completado
+            onConnection(req, [&res, items] { respondMetadata(res, *items); });
+        };
+        for (ResourceMetadata& item : *items) {
+            if (item.path.empty()) continue;
+            pending->fetch_add(1);
+            disk_io().stat(item.path, &item.st, [&item, finish](int result) mutable {
+                item.exists = result == 0 && S_ISREG(item.st.st_mode);
+                finish();
+            });
+        }
+        finish();
+    });
 }
 
 // ────────────────────────
 //      Route Handlers
 // ────────────────────────
 
-void setup_routes(crow::App<crow::CORSHandler>& app) {
+void setup_routes(crow::App<crow::CORSHandler, MetricsMiddleware, AdmissionMiddleware>& app) {
     CROW_ROUTE(app, "/token/<int>")
     .methods("GET"_method)([](const crow::request& req, crow::response& res, int max_uses) {
         if (!validateRequest(req, res)) return;
         std::string session_id = generate_csrf_token();
         std::string csrf_token = generate_csrf_token();
-        std::string encrypted_csrf_token = encrypt_token(csrf_token, ENV["ENCRYPTION_KEY"], std::stoi(ENV["ENCRYPTION_ROUNDS"]));
+        TokenDigestMode mode = config().digest_mode;
+        std::string encrypted_session_id = tokenDigest(session_id, mode);
+        std::string encrypted_csrf_token = tokenDigest(csrf_token, mode);
 
-        redis.setex("csrf_token:" + encrypt_token(session_id, ENV["ENCRYPTION_KEY"], std::stoi(ENV["ENCRYPTION_ROUNDS"])), 3600, encrypted_csrf_token);
-        redis.setex("token_uses:" + encrypt_token(session_id, ENV["ENCRYPTION_KEY"], std::stoi(ENV["ENCRYPTION_ROUNDS"])), 3600, std::to_string(max_uses));
+        try {
+            store_csrf_token(encrypted_session_id, encrypted_csrf_token, max_uses, 3600);
+        } catch (const sw::redis::Error& e) {
+            LOG_WARN("Token store unavailable", {"error", e.what()});
+            processCodeHTTP(res, 503);
+            return;
+        }
         
         res.write(crow::json::wvalue({{"session_id", session_id}, {"csrf_token", csrf_token}, {"max_uses", max_uses}}).dump());
         res.add_header("Content-Type", "application/json");
@@ -204,19 +1446,16 @@ void setup_routes(crow::App<crow::CORSHandler>& app) {
     ) {
         if (!validateRequest(req, res)) return;
         
-        std::string base_path = "Mangas/" + user + "/" + slug + "/" + 
-                              std::to_string(chapter) + "/" + 
-                              std::to_string(page);
-        
-        for (const auto& ext : VALID_EXTENSIONS) {
-            std::string path = base_path + "." + ext;
-            if (std::filesystem::exists(path)) {
-                handleFileRead(res, path);
-                return;
-            }
-        }
+        std::string chapter_key = "Mangas/" + user + "/" + slug + "/" + std::to_string(chapter);
+        std::string base_path = chapter_key + "/" + std::to_string(page);
         
-        processCodeHTTP(res, 404);
+        // La lectura es secuencial: tras servir N se calientan N+1..N+k. Todo lo que se usa
+        // después de readMangaPage se copia antes, porque la respuesta puede terminar dentro
+        // El presupuesto es por IP: X-Session-ID lo elige el cliente y rotarlo daría presupuesto sin límite
+        std::string client = req.remote_ip_address;
+        prefetcher().served(base_path);
+        readMangaPage(req, res, chapter_key, page);
+        prefetchAfter(client, chapter_key, page);
     });
 
     // POST: /Mangas/<user>/<slug>/<chapter>/<page>
@@ -229,26 +1468,79 @@ void setup_routes(crow::App<crow::CORSHandler>& app) {
         int chapter, 
         int page
     ) {
-        if (!validateRequest(req, res) || !validateCSRF(req, res)) return;
-        
-        std::string content_type = req.get_header_value("Content-Type");
-        std::cout << "Content-Type recibido: " << content_type << std::endl;
-        if (content_type.empty() || content_type.find("image/") == std::string::npos) {
-            processCodeHTTP(res, 400);
-            return;
-        }
+        if (!validateRequest(req, res)) return;
+        validateCSRF(req, res, [&req, &res, user, slug, chapter, page] {
+            std::string content_type = req.get_header_value("Content-Type");
+            LOG_DEBUG("Content-Type recibido", {"content_type", content_type});
+            if (content_type.empty() || content_type.find("image/") == std::string::npos) {
+                processCodeHTTP(res, 400);
+                return;
+            }
         
-        std::string extension = content_type.substr(content_type.find("/") + 1);
-        if (VALID_EXTENSIONS.find(extension) == VALID_EXTENSIONS.end()) {
-            processCodeHTTP(res, 400);
-            return;
-        }
+            std::string extension = content_type.substr(content_type.find("/") + 1);
+            if (VALID_EXTENSIONS.find(extension) == VALID_EXTENSIONS.end()) {
+                processCodeHTTP(res, 400);
+                return;
+            }
         
-        std::string path = "Mangas/" + user + "/" + slug + "/" + 
-                          std::to_string(chapter) + "/" + 
-                          std::to_string(page) + "." + extension;
+            std::string path = "Mangas/" + user + "/" + slug + "/" + 
+                              std::to_string(chapter) + "/" + 
+                              std::to_string(page) + "." + extension;
         
-        handleFileWrite(res, req, path);
+            handleFileWrite(res, req, path);
+        });
+    });
+
+    // GET: /Mangas/<user>/<slug>/<chapter>?from=<page>&to=<page>
+    // Todas las páginas del capítulo (o un rango) en una sola respuesta multipart/mixed
+    CROW_ROUTE(app, "/Mangas/<string>/<string>/<int>")
+    .methods("GET"_method)([](
+        const crow::request& req, 
+        crow::response& res, 
+        std::string user, 
+        std::string slug, 
+        int chapter
+    ) {
+        if (!validateRequest(req, res)) return;
+        // Listar el capítulo y construir el bundle lee todo el directorio: se hace en el pool de E/S
+        disk_io().blocking([&req, &res, user, slug, chapter] { handleChapterBundle(req, res, user, slug, chapter); });
+    });
+
+    // POST: /Mangas/<user>/<slug>/<chapter>
+    // Capítulo completo en multipart/form-data: un part por página, con el número de página como nombre
+    CROW_ROUTE(app, "/Mangas/<string>/<string>/<int>")
+    .methods("POST"_method)([](
+        const crow::request& req, 
+        crow::response& res, 
+        std::string user, 
+        std::string slug, 
+        int chapter
+    ) {
+        if (!validateRequest(req, res)) return;
+        validateCSRF(req, res, [&req, &res, user, slug, chapter] {
+            // Parsear el multipart, escribir las páginas y publicar el capítulo bloquea: se hace en el pool de E/S
+            disk_io().blocking([&req, &res, user, slug, chapter] {
+                handleChapterUpload(req, res, "Mangas/" + user + "/" + slug, chapter);
+            });
+        });
+    });
+
+    // POST: /Mangas/<user>/<slug>/<chapter>/seal
+    // Empaqueta todas las páginas del capítulo en un solo archivo con índice; las páginas se siguen pidiendo igual
+    CROW_ROUTE(app, "/Mangas/<string>/<string>/<int>/seal")
+    .methods("POST"_method)([](
+        const crow::request& req, 
+        crow::response& res, 
+        std::string user, 
+        std::string slug, 
+        int chapter
+    ) {
+        if (!validateRequest(req, res)) return;
+        validateCSRF(req, res, [&req, &res, user, slug, chapter] {
+            disk_io().blocking([&req, &res, user, slug, chapter] {
+                handleChapterSeal(req, res, "Mangas/" + user + "/" + slug + "/" + std::to_string(chapter), chapter);
+            });
+        });
     });
 
     // ──────────── Media: User Profile ────────────
@@ -265,16 +1557,8 @@ void setup_routes(crow::App<crow::CORSHandler>& app) {
     
         size_t dot_pos = filename.find_last_of('.');
         if (dot_pos == std::string::npos) {
-            // No tiene extensión, buscamos archivo existente con extensiones válidas
-            for (const auto& ext : VALID_EXTENSIONS) {
-                std::string path = "Media/" + user + "/" + filename + "." + ext;
-                if (std::filesystem::exists(path)) {
-                    handleFileRead(res, path);
-                    return;
-                }
-            }
-            // No se encontró ninguno con extensiones válidas
-            processCodeHTTP(res, 404);
+            // No tiene extensión, se resuelve con el índice de rutas
+            readResolved(req, res, "Media/" + user + "/" + filename, RouteFamily::Profiles);
             return;
         }
     
@@ -292,8 +1576,7 @@ void setup_routes(crow::App<crow::CORSHandler>& app) {
             return;
         }
     
-        std::string path = "Media/" + user + "/" + filename;
-        handleFileRead(res, path);
+        readLocated(req, res, "Media/" + user + "/" + filename, RouteFamily::Profiles);
     });
 
     // POST: /Media/Profiles/<user>/profilepicture o bannerpicture
@@ -304,27 +1587,28 @@ void setup_routes(crow::App<crow::CORSHandler>& app) {
         std::string user, 
         std::string type // "profilepicture" o "bannerpicture"
     ) {
-        if (!validateRequest(req, res) || !validateCSRF(req, res)) return;
-        
-        if (type != "profilepicture" && type != "bannerpicture") {
-            processCodeHTTP(res, 400);
-            return;
-        }
+        if (!validateRequest(req, res)) return;
+        validateCSRF(req, res, [&req, &res, user, type] {
+            if (type != "profilepicture" && type != "bannerpicture") {
+                processCodeHTTP(res, 400);
+                return;
+            }
         
-        std::string content_type = req.get_header_value("Content-Type");
-        if (content_type.empty() || content_type.find("image/") == std::string::npos) {
-            processCodeHTTP(res, 400);
-            return;
-        }
+            std::string content_type = req.get_header_value("Content-Type");
+            if (content_type.empty() || content_type.find("image/") == std::string::npos) {
+                processCodeHTTP(res, 400);
+                return;
+            }
         
-        std::string extension = content_type.substr(content_type.find("/") + 1);
-        if (VALID_EXTENSIONS.find(extension) == VALID_EXTENSIONS.end()) {
-            processCodeHTTP(res, 400);
-            return;
-        }
+            std::string extension = content_type.substr(content_type.find("/") + 1);
+            if (VALID_EXTENSIONS.find(extension) == VALID_EXTENSIONS.end()) {
+                processCodeHTTP(res, 400);
+                return;
+            }
         
-        std::string path = "Media/" + user + "/" + type + "." + extension;
-        handleFileWrite(res, req, path);
+            std::string path = "Media/" + user + "/" + type + "." + extension;
+            handleFileWrite(res, req, path);
+        });
     });
 
     // ──────────── Media: User Posts ────────────
@@ -341,15 +1625,7 @@ void setup_routes(crow::App<crow::CORSHandler>& app) {
         
         std::string base_path = "Media/" + user + "/Posts/" + post_id + "/" + std::to_string(page);
         
-        for (const auto& ext : VALID_EXTENSIONS) {
-            std::string path = base_path + "." + ext;
-            if (std::filesystem::exists(path)) {
-                handleFileRead(res, path);
-                return;
-            }
-        }
-        
-        processCodeHTTP(res, 404);
+        readResolved(req, res, base_path, RouteFamily::Posts);
     });
 
     // POST: /Media/Profiles/<user>/Posts/<post_id>/<page>
@@ -361,23 +1637,24 @@ void setup_routes(crow::App<crow::CORSHandler>& app) {
         std::string post_id, 
         int page
     ) {
-        if (!validateRequest(req, res) || !validateCSRF(req, res)) return;
-        
-        std::string content_type = req.get_header_value("Content-Type");
-        if (content_type.empty() || 
-            (content_type.find("image/") == std::string::npos && content_type.find("video/") == std::string::npos)) {
-            processCodeHTTP(res, 400);
-            return;
-        }
+        if (!validateRequest(req, res)) return;
+        validateCSRF(req, res, [&req, &res, user, post_id, page] {
+            std::string content_type = req.get_header_value("Content-Type");
+            if (content_type.empty() || 
+                (content_type.find("image/") == std::string::npos && content_type.find("video/") == std::string::npos)) {
+                processCodeHTTP(res, 400);
+                return;
+            }
         
-        std::string extension = content_type.substr(content_type.find("/") + 1);
-        if (VALID_EXTENSIONS.find(extension) == VALID_EXTENSIONS.end()) {
-            processCodeHTTP(res, 400);
-            return;
-        }
+            std::string extension = content_type.substr(content_type.find("/") + 1);
+            if (VALID_EXTENSIONS.find(extension) == VALID_EXTENSIONS.end()) {
+                processCodeHTTP(res, 400);
+                return;
+            }
         
-        std::string path = "Media/" + user + "/Posts/" + post_id + "/" + std::to_string(page) + "." + extension;
-        handleFileWrite(res, req, path);
+            std::string path = "Media/" + user + "/Posts/" + post_id + "/" + std::to_string(page) + "." + extension;
+            handleFileWrite(res, req, path);
+        });
     }); 
 
     // ──────────── Media: Group Posts ────────────
@@ -394,15 +1671,7 @@ void setup_routes(crow::App<crow::CORSHandler>& app) {
         
         std::string base_path = "Media/" + user + "/Groups/" + post_id + "/" + std::to_string(page);
         
-        for (const auto& ext : VALID_EXTENSIONS) {
-            std::string path = base_path + "." + ext;
-            if (std::filesystem::exists(path)) {
-                handleFileRead(res, path);
-                return;
-            }
-        }
-        
-        processCodeHTTP(res, 404);
+        readResolved(req, res, base_path, RouteFamily::Posts);
     });
 
     // POST: /Media/Profiles/<user>/Groups/<post_id>/<page>
@@ -414,23 +1683,24 @@ void setup_routes(crow::App<crow::CORSHandler>& app) {
         std::string post_id, 
         int page
     ) {
-        if (!validateRequest(req, res) || !validateCSRF(req, res)) return;
-        
-        std::string content_type = req.get_header_value("Content-Type");
-        if (content_type.empty() || 
-            (content_type.find("image/") == std::string::npos && content_type.find("video/") == std::string::npos)) {
-            processCodeHTTP(res, 400);
-            return;
-        }
+        if (!validateRequest(req, res)) return;
+        validateCSRF(req, res, [&req, &res, user, post_id, page] {
+            std::string content_type = req.get_header_value("Content-Type");
+            if (content_type.empty() || 
+                (content_type.find("image/") == std::string::npos && content_type.find("video/") == std::string::npos)) {
+                processCodeHTTP(res, 400);
+                return;
+            }
         
-        std::string extension = content_type.substr(content_type.find("/") + 1);
-        if (VALID_EXTENSIONS.find(extension) == VALID_EXTENSIONS.end()) {
-            processCodeHTTP(res, 400);
-            return;
-        }
+            std::string extension = content_type.substr(content_type.find("/") + 1);
+            if (VALID_EXTENSIONS.find(extension) == VALID_EXTENSIONS.end()) {
+                processCodeHTTP(res, 400);
+                return;
+            }
         
-        std::string path = "Media/" + user + "/Groups/" + post_id + "/" + std::to_string(page) + "." + extension;
-        handleFileWrite(res, req, path);
+            std::string path = "Media/" + user + "/Groups/" + post_id + "/" + std::to_string(page) + "." + extension;
+            handleFileWrite(res, req, path);
+        });
     }); 
 
     // ──────────── Media: Website Assets ────────────
@@ -464,29 +1734,74 @@ void setup_routes(crow::App<crow::CORSHandler>& app) {
         }
         else { // Images
             std::string ext = filename.substr(filename.find_last_of(".") + 1);
-            content_type = "image/" + (ext == "jpg" ? "jpeg" : ext);
+            if (ext == "svg") content_type = "image/svg+xml";
+            else content_type = "image/" + (ext == "jpg" ? "jpeg" : ext);
         }
         
-        if (std::filesystem::exists(path)) {
-            std::ifstream file(path, std::ios::binary);
-            if (!file) {
-                processCodeHTTP(res, 500);
-                return;
-            }
-            
-            res.add_header("Content-Type", content_type);
-            const size_t buffer_size = 8192;
-            char buffer[buffer_size];
-            
-            while (file.read(buffer, buffer_size) || file.gcount() > 0) {
-                res.write(std::string(buffer, file.gcount()));
-            }
-            
-            file.close();
-            res.end();
-        } else {
-            processCodeHTTP(res, 404);
-        }
+        sendAsset(req, res, path, content_type);
+    });
+
+    // ──────────── Metadata ────────────
+    // POST: /metadata
+    // {"resources": ["/Mangas/<user>/<slug>/<chapter>/<page>", ...]}: existencia, extensión, tamaño, mtime y ETag sin leer archivos
+    CROW_ROUTE(app, "/metadata")
+    .methods("POST"_method)([](const crow::request& req, crow::response& res) {
+        if (!validateRequest(req, res)) return;
+        handleMetadata(req, res);
+    });
+
+    // ──────────── Stats ────────────
+    // GET: /stats/cache
+    CROW_ROUTE(app, "/stats/cache")
+    .methods("GET"_method)([](const crow::request& req, crow::response& res) {
+        if (!validateRequest(req, res)) return;
+
+        FileCacheStats stats = hot_file_cache().stats();
+        uint64_t lookups = stats.hits + stats.misses;
+        crow::json::wvalue body;
+        body["hits"] = stats.hits;
+        body["misses"] = stats.misses;
+        body["hit_ratio"] = lookups ? static_cast<double>(stats.hits) / lookups : 0.0;
+        body["insertions"] = stats.insertions;
+        body["evictions"] = stats.evictions;
+        body["invalidations"] = stats.invalidations;
+        body["stale_rejections"] = stats.stale_rejections;
+        body["entries"] = stats.entries;
+        body["bytes"] = stats.bytes;
+        body["capacity_bytes"] = stats.capacity_bytes;
+
+        res.write(body.dump());
+        res.add_header("Content-Type", "application/json");
+        res.end();
+    });
+
+    // GET: /stats/index
+    CROW_ROUTE(app, "/stats/index")
+    .methods("GET"_method)([](const crow::request& req, crow::response& res) {
+        if (!validateRequest(req, res)) return;
+
+        PathIndexStats stats = path_index().stats();
+        crow::json::wvalue body;
+        body["entries"] = stats.entries;
+        body["hits"] = stats.hits;
+        body["negative_hits"] = stats.negative_hits;
+        body["fallbacks"] = stats.fallbacks;
+        body["rescans"] = stats.rescans;
+        body["authoritative"] = stats.authoritative;
+
+        res.write(body.dump());
+        res.add_header("Content-Type", "application/json");
+        res.end();
+    });
+
+    // GET: /metrics
+    CROW_ROUTE(app, "/metrics")
+    .methods("GET"_method)([](const crow::request& req, crow::response& res) {
+        if (!validateRequest(req, res)) return;
+
+        res.write(metrics().render());
+        res.add_header("Content-Type", "text/plain; version=0.0.4");
+        res.end();
     });
 
     CROW_ROUTE(app, "/beep")
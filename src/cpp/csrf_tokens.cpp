@@ -1,12 +1,9 @@
 #include "../csrf_tokens.h"
-#include "../token_encryption.h"
 #include "../env_loader.h"
 #include <string>
-#include <optional>
 #include <random>
 
-std::unordered_map<std::string, std::string> ENV = load_env_file(".env");
-sw::redis::Redis redis(ENV["REDIS_URL"]);
+const std::unordered_map<std::string, std::string> ENV = load_env_file(".env");
 
 std::string generate_csrf_token() {
     std::random_device rd;
@@ -25,14 +22,15 @@ std::string generate_csrf_token() {
     return token;
 }
 
-bool validate_csrf_token(const std::string& csrf_token, const std::string& session_id) {
-    const char* salt = std::getenv("ENCRYPTION_KEY");
-    const char* rounds_str = std::getenv("ENCRYPTION_ROUNDS");
-    if (!salt || !rounds_str || csrf_token.empty() || session_id.empty()) return false;
-    int rounds = std::stoi(rounds_str);
-    std::string encrypted_csrf_token = encrypt_token(csrf_token, salt, rounds);
-    std::string encrypted_session_id = encrypt_token(session_id, salt, rounds);
-    std::optional<std::string> csrf_token_from_redis = redis.get("csrf_token:" + encrypted_session_id);
-    return csrf_token_from_redis && *csrf_token_from_redis == encrypted_csrf_token;
+void store_csrf_token(const std::string& session_key, const std::string& token_value, int max_uses, int ttl_seconds) {
+    token_store().store(session_key, token_value, max_uses, ttl_seconds);
 }
 
+TokenStatus consume_csrf_token(const std::string& session_key, const std::string& token_value) {
+    return token_store().consume(session_key, token_value);
+}
+
+void consume_csrf_token(const std::string& session_key, const std::string& token_value,
+                        std::function<void(TokenStatus status)> done) {
+    token_store().consumeAsync(session_key, token_value, std::move(done));
+}
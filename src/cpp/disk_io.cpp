@@ -0,0 +1,571 @@
+#include "../disk_io.h"
+#include "../atomic_file.h"
+#include "../env_loader.h"
+#include "../logger.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <unistd.h>
+
+#ifdef PDFAST_IO_URING
+#include <liburing.h>
+#include <sys/eventfd.h>
+#include <sys/sysmacros.h>
+#endif
+
+// Una sola operación de io_uring no puede mover más de 2 GiB
+static const size_t MAX_TRANSFER = size_t{1} << 30;
+static const size_t WRITE_CHUNK = size_t{1} << 20;
+
+struct DiskIO::Op {
+    enum class Kind { Open, Stat, Read, Write, Fsync, Rename, Close, Task };
+
+    Kind kind;
+    std::string path;
+    std::string target;
+    int fd = -1;
+    int flags = 0;
+    mode_t mode = 0;
+    char* buffer = nullptr;
+    size_t length = 0;
+    uint64_t offset = 0;
+    struct stat* stat_out = nullptr;
+#ifdef PDFAST_IO_URING
+    struct statx statx_buf;
+#endif
+    std::function<void()> task;
+    Callback done;
+};
+
+struct DiskIO::Transfer {
+    int fd;
+    char* buffer;
+    size_t length;
+    uint64_t offset;
+    size_t transferred;
+    Callback done;
+};
+
+struct DiskIO::WriteJob {
+    std::string path;
+    std::string temp;
+    const char* data;
+    size_t size;
+    int fd = -1;
+    bool created_directories = false;
+    std::atomic<size_t> pending{0};
+    std::atomic<int> error{0};
+    Callback done;
+};
+
+#ifdef PDFAST_IO_URING
+struct DiskIO::Ring {
+    struct io_uring ring;
+};
+#endif
+
+static std::string directoryOf(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+DiskIO::DiskIO(unsigned queue_depth, size_t threads, bool use_uring) : pool(threads) {
+#ifdef PDFAST_IO_URING
+    if (use_uring) setupRing(queue_depth);
+#else
+    (void)queue_depth;
+    (void)use_uring;
+#endif
+    LOG_INFO("Disk I/O ready", {"backend", backend()});
+}
+
+DiskIO::~DiskIO() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+#ifdef PDFAST_IO_URING
+    if (ring) {
+        uint64_t one = 1;
+        if (::write(wake_fd, &one, sizeof(one)) < 0) {}
+        completer.join();
+        io_uring_queue_exit(&ring->ring);
+        ::close(wake_fd);
+    }
+#endif
+}
+
+const char* DiskIO::backend() const {
+#ifdef PDFAST_IO_URING
+    if (ring) return "io_uring";
+#endif
+    return "threads";
+}
+
+// ────────────────────────
+//      Submission
+// ────────────────────────
+
+void DiskIO::submit(std::unique_ptr<Op> op) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++outstanding;
+#ifdef PDFAST_IO_URING
+        if (ring && op->kind != Op::Kind::Task) {
+            queued.push_back(std::move(op));
+            // Solo la primera operación del lote despierta al hilo de completado
+            if (queued.size() > 1) return;
+        }
+#endif
+    }
+
+#ifdef PDFAST_IO_URING
+    if (!op) {
+        uint64_t one = 1;
+        if (::write(wake_fd, &one, sizeof(one)) < 0) {}
+        return;
+    }
+#endif
+
+    Op* raw = op.release();
+    pool.post([this, raw] { finish(raw, runBlocking(*raw)); });
+}
+
+void DiskIO::finish(Op* op, int result) {
+    std::unique_ptr<Op> owned(op);
+    try {
+        if (owned->kind == Op::Kind::Task) owned->task();
+        else owned->done(result);
+    } catch (const std::exception& e) {
+        LOG_ERROR("Disk I/O callback failed", {"error", e.what()});
+    }
+    owned.reset();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--outstanding == 0) idle_cv.notify_all();
+}
+
+int DiskIO::runBlocking(Op& op) {
+    int result = 0;
+    switch (op.kind) {
+        case Op::Kind::Open:
+            result = ::open(op.path.c_str(), op.flags, op.mode);
+            break;
+        case Op::Kind::Stat:
+            result = ::stat(op.path.c_str(), op.stat_out);
+            break;
+        case Op::Kind::Read:
+            do result = static_cast<int>(::pread(op.fd, op.buffer, op.length, op.offset));
+            while (result < 0 && errno == EINTR);
+            break;
+        case Op::Kind::Write:
+            do result = static_cast<int>(::pwrite(op.fd, op.buffer, op.length, op.offset));
+            while (result < 0 && errno == EINTR);
+            break;
+        case Op::Kind::Fsync:
+            result = ::fsync(op.fd);
+            break;
+        case Op::Kind::Rename:
+            result = std::rename(op.path.c_str(), op.target.c_str());
+            break;
+        case Op::Kind::Close:
+            result = ::close(op.fd);
+            break;
+        case Op::Kind::Task:
+            return 0;
+    }
+    return result < 0 ? -errno : result;
+}
+
+void DiskIO::drain() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle_cv.wait(lock, [this] { return outstanding == 0; });
+}
+
+// ────────────────────────
+//      Operations
+// ────────────────────────
+
+void DiskIO::open(const std::string& path, int flags, mode_t mode, Callback done) {
+    auto op = std::make_unique<Op>();
+    op->kind = Op::Kind::Open;
+    op->path = path;
+    op->flags = flags;
+    op->mode = mode;
+    op->done = std::move(done);
+    submit(std::move(op));
+}
+
+void DiskIO::stat(const std::string& path, struct stat* out, Callback done) {
+    auto op = std::make_unique<Op>();
+    op->kind = Op::Kind::Stat;
+    op->path = path;
+    op->stat_out = out;
+    op->done = std::move(done);
+    submit(std::move(op));
+}
+
+void DiskIO::read(int fd, char* buffer, size_t length, uint64_t offset, Callback done) {
+    auto op = std::make_unique<Op>();
+    op->kind = Op::Kind::Read;
+    op->fd = fd;
+    op->buffer = buffer;
+    op->length = std::min(length, MAX_TRANSFER);
+    op->offset = offset;
+    op->done = std::move(done);
+    submit(std::move(op));
+}
+
+void DiskIO::write(int fd, const char* buffer, size_t length, uint64_t offset, Callback done) {
+    auto op = std::make_unique<Op>();
+    op->kind = Op::Kind::Write;
+    op->fd = fd;
+    op->buffer = const_cast<char*>(buffer);
+    op->length = std::min(length, MAX_TRANSFER);
+    op->offset = offset;
+    op->done = std::move(done);
+    submit(std::move(op));
+}
+
+void DiskIO::fsync(int fd, Callback done) {
+    auto op = std::make_unique<Op>();
+    op->kind = Op::Kind::Fsync;
+    op->fd = fd;
+    op->done = std::move(done);
+    submit(std::move(op));
+}
+
+void DiskIO::rename(const std::string& from, const std::string& to, Callback done) {
+    auto op = std::make_unique<Op>();
+    op->kind = Op::Kind::Rename;
+    op->path = from;
+    op->target = to;
+    op->done = std::move(done);
+    submit(std::move(op));
+}
+
+void DiskIO::close(int fd, Callback done) {
+    auto op = std::make_unique<Op>();
+    op->kind = Op::Kind::Close;
+    op->fd = fd;
+    op->done = std::move(done);
+    submit(std::move(op));
+}
+
+void DiskIO::blocking(std::function<void()> task) {
+    auto op = std::make_unique<Op>();
+    op->kind = Op::Kind::Task;
+    op->task = std::move(task);
+    submit(std::move(op));
+}
+
+// ────────────────────────
+//      Composite Operations
+// ────────────────────────
+
+void DiskIO::readFully(int fd, char* buffer, size_t length, uint64_t offset, Callback done) {
+    readStep(std::make_shared<Transfer>(Transfer{fd, buffer, length, offset, 0, std::move(done)}));
+}
+
+void DiskIO::readStep(std::shared_ptr<Transfer> transfer) {
+    if (transfer->transferred == transfer->length) {
+        transfer->done(static_cast<int>(transfer->transferred));
+        return;
+    }
+    read(transfer->fd, transfer->buffer + transfer->transferred, transfer->length - transfer->transferred,
+         transfer->offset + transfer->transferred, [this, transfer](int result) {
+        if (result < 0) {
+            transfer->done(result);
+            return;
+        }
+        // Fin de archivo: el archivo se acortó mientras se leía
+        if (result == 0) {
+            transfer->done(static_cast<int>(transfer->transferred));
+            return;
+        }
+        transfer->transferred += result;
+        readStep(transfer);
+    });
+}
+
+void DiskIO::writeStep(std::shared_ptr<Transfer> transfer) {
+    if (transfer->transferred == transfer->length) {
+        transfer->done(static_cast<int>(transfer->transferred));
+        return;
+    }
+    write(transfer->fd, transfer->buffer + transfer->transferred, transfer->length - transfer->transferred,
+          transfer->offset + transfer->transferred, [this, transfer](int result) {
+        if (result <= 0) {
+            transfer->done(result < 0 ? result : -EIO);
+            return;
+        }
+        transfer->transferred += result;
+        writeStep(transfer);
+    });
+}
+
+void DiskIO::readFile(const std::string& path, std::shared_ptr<std::string> body, Callback done,
+                      std::shared_ptr<const struct stat> expected) {
+    open(path, O_RDONLY | O_CLOEXEC, 0, [this, body, done, expected](int fd) {
+        if (fd < 0) {
+            done(fd);
+            return;
+        }
+
+        // Un rename entre el stat y el open deja otro archivo detrás del path; fstat no toca el disco
+        struct stat st;
+        if (expected && (::fstat(fd, &st) != 0 || st.st_ino != expected->st_ino || st.st_size != expected->st_size ||
+                         st.st_mtim.tv_sec != expected->st_mtim.tv_sec || st.st_mtim.tv_nsec != expected->st_mtim.tv_nsec)) {
+            close(fd, [done](int) { done(-ESTALE); });
+            return;
+        }
+        readFully(fd, body->data(), body->size(), 0, [this, fd, body, done](int result) {
+            if (result >= 0) body->resize(result);
+            close(fd, [result, done](int) { done(result); });
+        });
+    });
+}
+
+void DiskIO::writeFile(const std::string& path, const char* data, size_t size, Callback done) {
+    auto job = std::make_shared<WriteJob>();
+    job->path = path;
+    job->temp = atomic_temp_path(path);
+    job->data = data;
+    job->size = size;
+    job->done = std::move(done);
+    openTemp(job);
+}
+
+void DiskIO::openTemp(std::shared_ptr<WriteJob> job) {
+    open(job->temp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644, [this, job](int fd) {
+        // El directorio padre se crea solo cuando falta, sin sondear antes con exists
+        if (fd == -ENOENT && !job->created_directories) {
+            job->created_directories = true;
+            blocking([this, job] {
+                std::error_code ec;
+                std::filesystem::create_directories(directoryOf(job->path), ec);
+                openTemp(job);
+            });
+            return;
+        }
+        if (fd < 0) {
+            job->done(fd);
+            return;
+        }
+        job->fd = fd;
+
+        size_t chunks = (job->size + WRITE_CHUNK - 1) / WRITE_CHUNK;
+        if (chunks == 0) {
+            commitTemp(job);
+            return;
+        }
+
+        // Todos los bloques se encolan a la vez y viajan en el mismo lote de io_uring
+        job->pending.store(chunks);
+        for (size_t offset = 0; offset < job->size; offset += WRITE_CHUNK) {
+            size_t length = std::min(WRITE_CHUNK, job->size - offset);
+            auto transfer = std::make_shared<Transfer>(Transfer{
+                fd, const_cast<char*>(job->data) + offset, length, offset, 0, [this, job](int result) {
+                    if (result < 0) {
+                        int expected = 0;
+                        job->error.compare_exchange_strong(expected, result);
+                    }
+                    if (job->pending.fetch_sub(1) != 1) return;
+                    int error = job->error.load();
+                    if (error != 0) abortTemp(job, error);
+                    else commitTemp(job);
+                }});
+            writeStep(transfer);
+        }
+    });
+}
+
+void DiskIO::commitTemp(std::shared_ptr<WriteJob> job) {
+    fsync(job->fd, [this, job](int result) {
+        if (result < 0) {
+            abortTemp(job, result);
+            return;
+        }
+        close(job->fd, [this, job](int result) {
+            job->fd = -1;
+            if (result < 0) {
+                abortTemp(job, result);
+                return;
+            }
+            rename(job->temp, job->path, [this, job](int result) {
+                if (result < 0) {
+                    abortTemp(job, result);
+                    return;
+                }
+                // Sincronizar el directorio para que el rename sobreviva a un corte
+                open(directoryOf(job->path), O_RDONLY | O_DIRECTORY | O_CLOEXEC, 0, [this, job](int dir_fd) {
+                    if (dir_fd < 0) {
+                        job->done(0);
+                        return;
+                    }
+                    fsync(dir_fd, [this, job, dir_fd](int) {
+                        close(dir_fd, [job](int) { job->done(0); });
+                    });
+                });
+            });
+        });
+    });
+}
+
+void DiskIO::abortTemp(std::shared_ptr<WriteJob> job, int error) {
+    blocking([job, error] {
+        if (job->fd >= 0) ::close(job->fd);
+        ::unlink(job->temp.c_str());
+        job->done(error);
+    });
+}
+
+// ────────────────────────
+//      io_uring
+// ────────────────────────
+
+#ifdef PDFAST_IO_URING
+bool DiskIO::setupRing(unsigned queue_depth) {
+    ring = std::make_unique<Ring>();
+    int result = io_uring_queue_init(queue_depth, &ring->ring, 0);
+    if (result < 0) {
+        // Docker bloquea io_uring con su perfil seccomp por defecto
+        LOG_WARN("io_uring unavailable, using the blocking pool", {"error", std::strerror(-result)});
+        ring.reset();
+        return false;
+    }
+
+    bool supported = false;
+    if (io_uring_probe* probe = io_uring_get_probe_ring(&ring->ring)) {
+        supported = true;
+        for (int opcode : {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_WRITE,
+                           IORING_OP_FSYNC, IORING_OP_RENAMEAT, IORING_OP_CLOSE})
+            supported = supported && io_uring_opcode_supported(probe, opcode);
+        io_uring_free_probe(probe);
+    }
+    wake_fd = supported ? eventfd(0, EFD_CLOEXEC) : -1;
+    if (wake_fd < 0) {
+        LOG_WARN("io_uring lacks required operations, using the blocking pool");
+        io_uring_queue_exit(&ring->ring);
+        ring.reset();
+        return false;
+    }
+
+    completer = std::thread(&DiskIO::runRing, this);
+    return true;
+}
+
+void DiskIO::armWake() {
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring->ring);
+    if (!sqe) {
+        io_uring_submit(&ring->ring);
+        sqe = io_uring_get_sqe(&ring->ring);
+    }
+    io_uring_prep_read(sqe, wake_fd, &wake_value, sizeof(wake_value), 0);
+    io_uring_sqe_set_data(sqe, nullptr);
+}
+
+static void fillStat(const struct statx& source, struct stat& target) {
+    target = {};
+    target.st_dev = makedev(source.stx_dev_major, source.stx_dev_minor);
+    target.st_ino = source.stx_ino;
+    target.st_mode = source.stx_mode;
+    target.st_nlink = source.stx_nlink;
+    target.st_uid = source.stx_uid;
+    target.st_gid = source.stx_gid;
+    target.st_rdev = makedev(source.stx_rdev_major, source.stx_rdev_minor);
+    target.st_size = static_cast<off_t>(source.stx_size);
+    target.st_blksize = source.stx_blksize;
+    target.st_blocks = static_cast<blkcnt_t>(source.stx_blocks);
+    target.st_atim = {source.stx_atime.tv_sec, source.stx_atime.tv_nsec};
+    target.st_mtim = {source.stx_mtime.tv_sec, source.stx_mtime.tv_nsec};
+    target.st_ctim = {source.stx_ctime.tv_sec, source.stx_ctime.tv_nsec};
+}
+
+void DiskIO::runRing() {
+    io_uring* uring = &ring->ring;
+    size_t in_flight = 0;
+    bool wake_armed = false;
+
+    while (true) {
+        std::deque<std::unique_ptr<Op>> batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batch.swap(queued);
+            if (stopping && batch.empty() && in_flight == 0) break;
+        }
+
+        if (!wake_armed) {
+            armWake();
+            wake_armed = true;
+        }
+
+        // Todo lo encolado desde el último despertar se envía con una sola llamada al kernel
+        for (std::unique_ptr<Op>& op : batch) {
+            io_uring_sqe* sqe = io_uring_get_sqe(uring);
+            if (!sqe) {
+                io_uring_submit(uring);
+                sqe = io_uring_get_sqe(uring);
+            }
+            switch (op->kind) {
+                case Op::Kind::Open:
+                    io_uring_prep_openat(sqe, AT_FDCWD, op->path.c_str(), op->flags, op->mode);
+                    break;
+                case Op::Kind::Stat:
+                    io_uring_prep_statx(sqe, AT_FDCWD, op->path.c_str(), 0, STATX_BASIC_STATS, &op->statx_buf);
+                    break;
+                case Op::Kind::Read:
+                    io_uring_prep_read(sqe, op->fd, op->buffer, static_cast<unsigned>(op->length), op->offset);
+                    break;
+                case Op::Kind::Write:
+                    io_uring_prep_write(sqe, op->fd, op->buffer, static_cast<unsigned>(op->length), op->offset);
+                    break;
+                case Op::Kind::Fsync:
+                    io_uring_prep_fsync(sqe, op->fd, 0);
+                    break;
+                case Op::Kind::Rename:
+                    io_uring_prep_renameat(sqe, AT_FDCWD, op->path.c_str(), AT_FDCWD, op->target.c_str(), 0);
+                    break;
+                case Op::Kind::Close:
+                    io_uring_prep_close(sqe, op->fd);
+                    break;
+                case Op::Kind::Task:
+                    break;
+            }
+            io_uring_sqe_set_data(sqe, op.release());
+            ++in_flight;
+        }
+
+        int submitted = io_uring_submit_and_wait(uring, 1);
+        if (submitted < 0 && submitted != -EINTR && submitted != -EAGAIN && submitted != -EBUSY)
+            LOG_ERROR("io_uring submit failed", {"error", std::strerror(-submitted)});
+
+        io_uring_cqe* cqe;
+        while (io_uring_peek_cqe(uring, &cqe) == 0) {
+            Op* op = static_cast<Op*>(io_uring_cqe_get_data(cqe));
+            int result = cqe->res;
+            io_uring_cqe_seen(uring, cqe);
+
+            if (!op) {
+                wake_armed = false;
+                continue;
+            }
+            --in_flight;
+            if (op->kind == Op::Kind::Stat && result >= 0) fillStat(op->statx_buf, *op->stat_out);
+            finish(op, result);
+        }
+    }
+}
+#endif
+
+DiskIO& disk_io() {
+    static DiskIO io(
+        static_cast<unsigned>(std::clamp(env_integer("DISK_IO_QUEUE_DEPTH", 256), 8LL, 4096LL)),
+        static_cast<size_t>(std::max(1LL, env_integer("DISK_IO_THREADS", 8))),
+        env_string("DISK_IO_BACKEND", "auto") != "threads");
+    return io;
+}
@@ -20,4 +20,20 @@ std::unordered_map<std::string, std::string> load_env_file(const std::string& fi
     }
 
     return variables;
+}
+
+long long env_integer(const std::string& name, long long fallback) {
+    auto it = ENV.find(name);
+    if (it == ENV.end() || it->second.empty()) return fallback;
+    try {
+        return std::stoll(it->second);
+    } catch (const std::exception&) {
+        std::cerr << "Invalid integer for " << name << ": " << it->second << std::endl;
+        return fallback;
+    }
+}
+
+std::string env_string(const std::string& name, const std::string& fallback) {
+    auto it = ENV.find(name);
+    return it == ENV.end() ? fallback : it->second;
 }
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "../file_cache.h"
+#include "../env_loader.h"
+#include <functional>
+
+FileCache::FileCache(size_t capacity_bytes, size_t max_entry_bytes, size_t shard_count)
+    : capacity_bytes(capacity_bytes),
+      shard_capacity(capacity_bytes / (shard_count ? shard_count : 1)),
+      max_entry_bytes(max_entry_bytes) {
+    if (shard_count == 0) shard_count = 1;
+    shards.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i)
+        shards.push_back(std::make_unique<Shard>());
+}
+
+FileCache::Shard& FileCache::shardFor(const std::string& path) {
+    return *shards[std::hash<std::string>{}(path) % shards.size()];
+}
+
+bool FileCache::admits(uintmax_t size) const {
+    return size <= max_entry_bytes && size <= shard_capacity;
+}
+
+std::shared_ptr<const CachedFile> FileCache::get(const std::string& path) {
+    Shard& shard = shardFor(path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.index.find(path);
+    if (it == shard.index.end()) {
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    hits.fetch_add(1, std::memory_order_relaxed);
+    return it->second->file;
+}
+
+uint64_t FileCache::generation(const std::string& path) {
+    Shard& shard = shardFor(path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.generation;
+}
+
+bool FileCache::contains(const std::string& path) {
+    Shard& shard = shardFor(path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.index.contains(path);
+}
+
+bool FileCache::put(const std::string& path, std::shared_ptr<const CachedFile> file, uint64_t generation,
+                    bool speculative) {
+    if (!file || !admits(file->body.size())) return false;
+
+    Shard& shard = shardFor(path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Un write o invalidate ocurrió mientras se leía el disco
+    if (shard.generation != generation) {
+        stale_rejections.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    auto it = shard.index.find(path);
+    if (speculative) {
+        // La lectura anticipada nunca desplaza lo que ya está en caché
+        if (it != shard.index.end() || shard.bytes + file->body.size() > shard_capacity) return false;
+        shard.lru.push_back({path, file});
+        shard.index.emplace(path, std::prev(shard.lru.end()));
+        entries.fetch_add(1, std::memory_order_relaxed);
+    } else if (it != shard.index.end()) {
+        shard.bytes -= it->second->file->body.size();
+        bytes.fetch_sub(it->second->file->body.size(), std::memory_order_relaxed);
+        it->second->file = file;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    } else {
+        shard.lru.push_front({path, file});
+        shard.index.emplace(path, shard.lru.begin());
+        entries.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    shard.bytes += file->body.size();
+    bytes.fetch_add(file->body.size(), std::memory_order_relaxed);
+    insertions.fetch_add(1, std::memory_order_relaxed);
+    evict(shard);
+    return true;
+}
+
+void FileCache::invalidate(const std::string& path) {
+    Shard& shard = shardFor(path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    shard.generation++;
+    auto it = shard.index.find(path);
+    if (it == shard.index.end()) return;
+
+    shard.bytes -= it->second->file->body.size();
+    bytes.fetch_sub(it->second->file->body.size(), std::memory_order_relaxed);
+    entries.fetch_sub(1, std::memory_order_relaxed);
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+    invalidations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FileCache::evict(Shard& shard) {
+    while (shard.bytes > shard_capacity && !shard.lru.empty()) {
+        Entry& victim = shard.lru.back();
+        shard.bytes -= victim.file->body.size();
+        bytes.fetch_sub(victim.file->body.size(), std::memory_order_relaxed);
+        entries.fetch_sub(1, std::memory_order_relaxed);
+        shard.index.erase(victim.path);
+        shard.lru.pop_back();
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+FileCacheStats FileCache::stats() const {
+    return {
+        hits.load(std::memory_order_relaxed),
+        misses.load(std::memory_order_relaxed),
+        insertions.load(std::memory_order_relaxed),
+        evictions.load(std::memory_order_relaxed),
+        invalidations.load(std::memory_order_relaxed),
+        stale_rejections.load(std::memory_order_relaxed),
+        bytes.load(std::memory_order_relaxed),
+        entries.load(std::memory_order_relaxed),
+        capacity_bytes
+    };
+}
+
+FileCache& hot_file_cache() {
+    static FileCache cache(
+        static_cast<size_t>(env_integer("FILE_CACHE_BYTES", 256LL * 1024 * 1024)),
+        static_cast<size_t>(env_integer("FILE_CACHE_MAX_ENTRY_BYTES", 8LL * 1024 * 1024)),
+        static_cast<size_t>(env_integer("FILE_CACHE_SHARDS", 16))
+    );
+    return cache;
+}
@@ -0,0 +1,49 @@
+#include "../http_conditional.h"
+
+std::string http_date(time_t timestamp) {
+    struct tm gmt;
+    gmtime_r(&timestamp, &gmt);
+    char buffer[32];
+    strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+    return buffer;
+}
+
+bool parse_http_date(const std::string& value, time_t& timestamp) {
+    struct tm gmt = {};
+    const char* end = strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+    if (!end || *end != '\0') return false;
+    timestamp = timegm(&gmt);
+    return timestamp != static_cast<time_t>(-1);
+}
+
+static std::string opaqueTag(std::string tag) {
+    if (tag.compare(0, 2, "W/") == 0) tag.erase(0, 2);
+    return tag;
+}
+
+bool etag_list_matches(const std::string& header, const std::string& etag) {
+    std::string current = opaqueTag(etag);
+    size_t pos = 0;
+    while (pos < header.size()) {
+        size_t comma = header.find(',', pos);
+        if (comma == std::string::npos) comma = header.size();
+
+        size_t start = header.find_first_not_of(" \t", pos);
+        size_t end = header.find_last_not_of(" \t", comma - 1);
+        if (start != std::string::npos && start < comma && end >= start) {
+            std::string tag = header.substr(start, end - start + 1);
+            if (tag == "*" || opaqueTag(tag) == current) return true;
+        }
+        pos = comma + 1;
+    }
+    return false;
+}
+
+bool is_not_modified(const std::string& if_none_match, const std::string& if_modified_since,
+                     const std::string& etag, time_t last_modified) {
+    if (!if_none_match.empty()) return etag_list_matches(if_none_match, etag);
+    if (if_modified_since.empty()) return false;
+
+    time_t since;
+    return parse_http_date(if_modified_since, since) && last_modified <= since;
+}
@@ -0,0 +1,88 @@
+#include "../http_range.h"
+#include <algorithm>
+#include <cctype>
+
+static std::string trim(const std::string& value) {
+    size_t start = value.find_first_not_of(" \t");
+    if (start == std::string::npos) return "";
+    size_t end = value.find_last_not_of(" \t");
+    return value.substr(start, end - start + 1);
+}
+
+static bool parseNumber(const std::string& text, uintmax_t& value) {
+    if (text.empty() || text.size() > 19) return false;
+    value = 0;
+    for (char c : text) {
+        if (!std::isdigit(static_cast<unsigned char>(c))) return false;
+        value = value * 10 + static_cast<uintmax_t>(c - '0');
+    }
+    return true;
+}
+
+RangeResult parse_range_header(const std::string& header, uintmax_t file_size,
+                               std::vector<ByteRange>& ranges, size_t max_ranges) {
+    ranges.clear();
+    const std::string unit = "bytes=";
+    if (header.compare(0, unit.size(), unit) != 0) return RangeResult::Ignored;
+
+    size_t specs = 0;
+    size_t pos = unit.size();
+    while (pos <= header.size()) {
+        size_t comma = header.find(',', pos);
+        if (comma == std::string::npos) comma = header.size();
+        std::string spec = trim(header.substr(pos, comma - pos));
+        pos = comma + 1;
+
+        if (spec.empty()) continue;
+        if (++specs > max_ranges) return RangeResult::Ignored;
+
+        size_t dash = spec.find('-');
+        if (dash == std::string::npos) return RangeResult::Ignored;
+        std::string first_text = trim(spec.substr(0, dash));
+        std::string last_text = trim(spec.substr(dash + 1));
+
+        uintmax_t first = 0, last = 0;
+        bool open_ended = false;
+        if (first_text.empty()) {
+            // Sufijo: los últimos N bytes
+            uintmax_t suffix;
+            if (!parseNumber(last_text, suffix)) return RangeResult::Ignored;
+            if (suffix == 0 || file_size == 0) continue;
+            first = suffix >= file_size ? 0 : file_size - suffix;
+            last = file_size - 1;
+        } else {
+            if (!parseNumber(first_text, first)) return RangeResult::Ignored;
+            if (last_text.empty()) {
+                last = file_size ? file_size - 1 : 0;
+                open_ended = true;
+            } else {
+                if (!parseNumber(last_text, last) || last < first) return RangeResult::Ignored;
+                if (file_size && last >= file_size) last = file_size - 1;
+            }
+            if (first >= file_size) continue;
+        }
+        ranges.push_back({first, last, open_ended});
+    }
+
+    if (specs == 0) return RangeResult::Ignored;
+    if (ranges.empty()) return RangeResult::Unsatisfiable;
+
+    std::sort(ranges.begin(), ranges.end(), [](const ByteRange& a, const ByteRange& b) {
+        return a.first < b.first;
+    });
+    std::vector<ByteRange> merged;
+    for (const ByteRange& range : ranges) {
+        if (!merged.empty() && range.first <= merged.back().last + 1) {
+            merged.back().last = std::max(merged.back().last, range.last);
+            merged.back().open_ended = merged.back().open_ended || range.open_ended;
+        } else
+            merged.push_back(range);
+    }
+    ranges.swap(merged);
+    return RangeResult::Satisfiable;
+}
+
+std::string content_range(const ByteRange& range, uintmax_t file_size) {
+    return "bytes " + std::to_string(range.first) + "-" + std::to_string(range.last) +
+           "/" + std::to_string(file_size);
+}
@@ -0,0 +1,390 @@
+#include "../image_variants.h"
+#include "../atomic_file.h"
+#include "../env_loader.h"
+#include "../file_cache.h"
+#include "../logger.h"
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <jpeglib.h>
+#include <png.h>
+
+// ────────────────────────
+//      Codecs
+// ────────────────────────
+
+// Píxeles RGB (JPEG) o RGBA (PNG) en filas contiguas
+struct Image {
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::vector<unsigned char> pixels;
+    std::vector<std::string> exif;
+};
+
+static constexpr uint64_t MAX_PIXELS = 64ULL * 1024 * 1024;
+
+struct JpegError {
+    jpeg_error_mgr manager;
+    std::jmp_buf jump;
+};
+
+static void jpegErrorExit(j_common_ptr info) {
+    // libjpeg llama a exit() por defecto; se vuelve al setjmp del llamador
+    std::longjmp(reinterpret_cast<JpegError*>(info->err)->jump, 1);
+}
+
+static bool decodeJpeg(const std::string& data, int target, Image& image) {
+    jpeg_decompress_struct info;
+    JpegError error;
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = jpegErrorExit;
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, reinterpret_cast<const unsigned char*>(data.data()), data.size());
+    jpeg_save_markers(&info, JPEG_APP0 + 1, 0xFFFF);
+    jpeg_read_header(&info, TRUE);
+    if (static_cast<uint64_t>(info.image_width) * info.image_height > MAX_PIXELS) {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    // El decodificador escala por 1/2, 1/4 o 1/8 casi gratis mientras siga sobrando resolución
+    info.out_color_space = JCS_RGB;
+    info.scale_num = 1;
+    info.scale_denom = 1;
+    unsigned int longest = std::max(info.image_width, info.image_height);
+    while (info.scale_denom < 8 && longest / (info.scale_denom * 2) >= static_cast<unsigned int>(target))
+        info.scale_denom *= 2;
+
+    // EXIF se conserva para que la orientación siga siendo la del original
+    for (jpeg_saved_marker_ptr marker = info.marker_list; marker; marker = marker->next)
+        image.exif.emplace_back(reinterpret_cast<const char*>(marker->data), marker->data_length);
+
+    jpeg_start_decompress(&info);
+    image.width = info.output_width;
+    image.height = info.output_height;
+    image.channels = 3;
+    image.pixels.resize(static_cast<size_t>(image.width) * image.height * 3);
+    while (info.output_scanline < info.output_height) {
+        JSAMPROW row = image.pixels.data() + static_cast<size_t>(info.output_scanline) * image.width * 3;
+        jpeg_read_scanlines(&info, &row, 1);
+    }
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    return true;
+}
+
+static bool encodeJpeg(const Image& image, int quality, std::string& out) {
+    jpeg_compress_struct info;
+    JpegError error;
+    unsigned char* buffer = nullptr;
+    unsigned long size = 0;
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = jpegErrorExit;
+    if (setjmp(error.jump)) {
+        jpeg_destroy_compress(&info);
+        free(buffer);
+        return false;
+    }
+
+    jpeg_create_compress(&info);
+    jpeg_mem_dest(&info, &buffer, &size);
+    info.image_width = image.width;
+    info.image_height = image.height;
+    info.input_components = 3;
+    info.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&info);
+    jpeg_set_quality(&info, quality, TRUE);
+    info.optimize_coding = TRUE;
+    jpeg_start_compress(&info, TRUE);
+
+    for (const std::string& exif : image.exif)
+        jpeg_write_marker(&info, JPEG_APP0 + 1, reinterpret_cast<const JOCTET*>(exif.data()), exif.size());
+
+    while (info.next_scanline < info.image_height) {
+        JSAMPROW row = const_cast<unsigned char*>(image.pixels.data()) +
+                       static_cast<size_t>(info.next_scanline) * image.width * 3;
+        jpeg_write_scanlines(&info, &row, 1);
+    }
+    jpeg_finish_compress(&info);
+    out.assign(reinterpret_cast<const char*>(buffer), size);
+    jpeg_destroy_compress(&info);
+    free(buffer);
+    return true;
+}
+
+static bool decodePng(const std::string& data, Image& image) {
+    png_image info{};
+    info.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_memory(&info, data.data(), data.size())) return false;
+    if (static_cast<uint64_t>(info.width) * info.height > MAX_PIXELS) {
+        png_image_free(&info);
+        return false;
+    }
+
+    info.format = PNG_FORMAT_RGBA;
+    image.width = info.width;
+    image.height = info.height;
+    image.channels = 4;
+    image.pixels.resize(PNG_IMAGE_SIZE(info));
+    if (!png_image_finish_read(&info, nullptr, image.pixels.data(), 0, nullptr)) {
+        png_image_free(&info);
+        return false;
+    }
+    return true;
+}
+
+static bool encodePng(const Image& image, std::string& out) {
+    png_image info{};
+    info.version = PNG_IMAGE_VERSION;
+    info.width = image.width;
+    info.height = image.height;
+    info.format = PNG_FORMAT_RGBA;
+
+    png_alloc_size_t size = 0;
+    if (!png_image_write_get_memory_size(info, size, 0, image.pixels.data(), 0, nullptr)) return false;
+    out.resize(size);
+    if (!png_image_write_to_memory(&info, out.data(), &size, 0, image.pixels.data(), 0, nullptr)) return false;
+    out.resize(size);
+    return true;
+}
+
+// Promedio por áreas; con alfa se pondera cada color por su opacidad para no oscurecer los bordes
+static Image downscale(const Image& source, int width, int height) {
+    Image target;
+    target.width = width;
+    target.height = height;
+    target.channels = source.channels;
+    target.exif = source.exif;
+    target.pixels.resize(static_cast<size_t>(width) * height * source.channels);
+
+    const int channels = source.channels;
+    const bool alpha = channels == 4;
+    for (int y = 0; y < height; ++y) {
+        int y0 = static_cast<int>(static_cast<int64_t>(y) * source.height / height);
+        int y1 = std::max(y0 + 1, static_cast<int>(static_cast<int64_t>(y + 1) * source.height / height));
+        for (int x = 0; x < width; ++x) {
+            int x0 = static_cast<int>(static_cast<int64_t>(x) * source.width / width);
+            int x1 = std::max(x0 + 1, static_cast<int>(static_cast<int64_t>(x + 1) * source.width / width));
+
+            uint64_t sums[4] = {0, 0, 0, 0};
+            uint64_t weight = 0;
+            for (int sy = y0; sy < y1; ++sy) {
+                const unsigned char* row = source.pixels.data() + (static_cast<size_t>(sy) * source.width + x0) * channels;
+                for (int sx = x0; sx < x1; ++sx, row += channels) {
+                    uint64_t a = alpha ? row[3] : 1;
+                    for (int c = 0; c < 3; ++c) sums[c] += row[c] * a;
+                    if (alpha) sums[3] += row[3];
+                    weight += a;
+                }
+            }
+
+            uint64_t count = static_cast<uint64_t>(y1 - y0) * (x1 - x0);
+            unsigned char* out = target.pixels.data() + (static_cast<size_t>(y) * width + x) * channels;
+            for (int c = 0; c < 3; ++c) out[c] = weight ? static_cast<unsigned char>(sums[c] / weight) : 0;
+            if (alpha) out[3] = static_cast<unsigned char>(sums[3] / count);
+        }
+    }
+    return target;
+}
+
+static std::string lowerExtension(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return "";
+    std::string extension = path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension;
+}
+
+// ────────────────────────
+//      Variants
+// ────────────────────────
+
+ImageVariants::ImageVariants(std::vector<int> sizes, size_t threads, int quality)
+    : sizes(std::move(sizes)), quality(std::clamp(quality, 1, 100)), pool(threads) {
+    std::sort(this->sizes.begin(), this->sizes.end());
+}
+
+bool ImageVariants::supports(const std::string& path) const {
+    if (sizes.empty()) return false;
+    std::string extension = lowerExtension(path);
+    return extension == "jpg" || extension == "jpeg" || extension == "png";
+}
+
+std::string ImageVariants::variantPath(const std::string& path, int size) {
+    std::filesystem::path original(path);
+    return (original.parent_path() / ".variants" /
+            (original.stem().string() + "." + std::to_string(size) + original.extension().string())).string();
+}
+
+ImageVariants::Stripe& ImageVariants::stripeFor(const std::string& path) {
+    return stripes[std::hash<std::string>{}(path) % STRIPE_COUNT];
+}
+
+// Requiere el mutex de la franja
+void ImageVariants::removeVariants(const std::string& path) {
+    for (int size : sizes) {
+        std::string variant = variantPath(path, size);
+        std::remove(variant.c_str());
+        hot_file_cache().invalidate(variant);
+    }
+}
+
+// Requiere el mutex de la franja
+void ImageVariants::queue(Stripe& stripe, const std::string& path) {
+    State& state = stripe.states[path];
+    uint64_t generation = state.generation = ++stripe.next_generation;
+    state.running = true;
+    pool.post([this, path, generation] { generate(path, generation); });
+
+    // Acotado: olvidar un intento fallido solo hace que se repita en la siguiente petición
+    if (stripe.states.size() <= STRIPE_STATES) return;
+    for (auto it = stripe.states.begin(); it != stripe.states.end(); ++it) {
+        if (!it->second.running) {
+            stripe.states.erase(it);
+            return;
+        }
+    }
+}
+
+void ImageVariants::schedule(const std::string& path) {
+    if (!supports(path)) return;
+    Stripe& stripe = stripeFor(path);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    removeVariants(path);
+    queue(stripe, path);
+}
+
+VariantChoice ImageVariants::select(const std::string& path, int requested) {
+    auto size = std::lower_bound(sizes.begin(), sizes.end(), requested);
+    if (size == sizes.end() || !supports(path)) return {"", false};
+
+    std::string variant = variantPath(path, *size);
+    struct stat original_st, variant_st;
+    if (stat(path.c_str(), &original_st) != 0) return {"", false};
+    bool exists = stat(variant.c_str(), &variant_st) == 0;
+    bool fresh = exists && variant_st.st_mtime >= original_st.st_mtime;
+
+    Stripe& stripe = stripeFor(path);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    auto it = stripe.states.find(path);
+    bool running = it != stripe.states.end() && it->second.running;
+    if (fresh && !running) return {variant, false};
+    if (running) return {"", true};
+
+    // Originales subidos antes del arranque o reemplazados fuera de la API
+    if (it == stripe.states.end() || exists) {
+        removeVariants(path);
+        queue(stripe, path);
+        return {"", true};
+    }
+
+    // Ya se intentó: la imagen es más pequeña que la variante o no se pudo decodificar
+    return {"", false};
+}
+
+void ImageVariants::generate(const std::string& path, uint64_t generation) {
+    Stripe& stripe = stripeFor(path);
+    bool complete = true;
+    auto finish = [&] {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto it = stripe.states.find(path);
+        if (it == stripe.states.end() || it->second.generation != generation) return;
+        // Con todas las variantes en disco, select() las encuentra sin necesitar el estado
+        if (complete) stripe.states.erase(it);
+        else it->second.running = false;
+    };
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        complete = false;
+        finish();
+        return;
+    }
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    std::string data = buffer.str();
+
+    std::string extension = lowerExtension(path);
+    bool jpeg = extension != "png";
+    Image image;
+    bool decoded = jpeg ? decodeJpeg(data, sizes.back(), image) : decodePng(data, image);
+    data.clear();
+    data.shrink_to_fit();
+    if (!decoded) {
+        LOG_WARN("Cannot decode image for variants", {"path", path});
+        complete = false;
+        finish();
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path() / ".variants", error);
+
+    // Se generan de mayor a menor reduciendo siempre desde el original decodificado
+    for (auto size = sizes.rbegin(); size != sizes.rend(); ++size) {
+        int longest = std::max(image.width, image.height);
+        if (*size >= longest) {
+            complete = false;
+            continue;
+        }
+
+        int width = std::max(1, static_cast<int>(static_cast<int64_t>(image.width) * *size / longest));
+        int height = std::max(1, static_cast<int>(static_cast<int64_t>(image.height) * *size / longest));
+        Image scaled = downscale(image, width, height);
+
+        std::string encoded;
+        if (!(jpeg ? encodeJpeg(scaled, quality, encoded) : encodePng(scaled, encoded))) {
+            complete = false;
+            continue;
+        }
+
+        std::string variant = variantPath(path, *size);
+        AtomicFileWriter writer(variant, false);
+        if (!writer.open() || !writer.append(encoded.data(), encoded.size())) {
+            complete = false;
+            continue;
+        }
+
+        // El commit se hace bajo el mutex: una resubida no puede colarse entre la comprobación y el rename
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto state = stripe.states.find(path);
+        if (state == stripe.states.end() || state->second.generation != generation) return;
+        if (writer.commit()) hot_file_cache().invalidate(variant);
+        else complete = false;
+    }
+
+    finish();
+}
+
+ImageVariants& image_variants() {
+    static ImageVariants variants = [] {
+        std::vector<int> sizes;
+        std::string list = env_string("IMAGE_VARIANT_SIZES", "64,256,1024");
+        std::stringstream stream(list);
+        for (std::string item; std::getline(stream, item, ',');) {
+            try {
+                int size = std::stoi(item);
+                if (size > 0) sizes.push_back(size);
+            } catch (const std::exception&) {
+                LOG_WARN("Invalid size in IMAGE_VARIANT_SIZES", {"size", item});
+            }
+        }
+        return ImageVariants(
+            sizes,
+            static_cast<size_t>(std::max(1LL, env_integer("IMAGE_VARIANT_WORKERS", 2))),
+            static_cast<int>(env_integer("IMAGE_VARIANT_QUALITY", 82)));
+    }();
+    return variants;
+}
@@ -0,0 +1,207 @@
+#include "../logger.h"
+#include "../env_loader.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+static const char* LEVEL_NAMES[] = {"debug", "info", "warn", "error"};
+
+static int64_t nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static LogLevel parseLevel(const std::string& name) {
+    if (name == "debug") return LogLevel::Debug;
+    if (name == "warn") return LogLevel::Warn;
+    if (name == "error") return LogLevel::Error;
+    return LogLevel::Info;
+}
+
+// Escritura acotada dentro del slot; lo que no cabe se trunca
+class SlotWriter {
+public:
+    SlotWriter(char* text, size_t capacity) : text(text), capacity(capacity) {}
+
+    void raw(std::string_view value) {
+        size_t n = std::min(value.size(), capacity - length);
+        std::memcpy(text + length, value.data(), n);
+        length += n;
+    }
+
+    // Valores con espacios, comillas o '=' van entre comillas como en logfmt
+    void value(std::string_view value) {
+        bool quote = value.empty() || value.find_first_of(" \"=\t\r\n") != std::string_view::npos;
+        if (!quote) {
+            raw(value);
+            return;
+        }
+        raw("\"");
+        for (char c : value) {
+            if (c == '"' || c == '\\') raw("\\");
+            if (c == '\n') raw("\\n");
+            else if (c == '\r') raw("\\r");
+            else raw(std::string_view(&c, 1));
+        }
+        raw("\"");
+    }
+
+    size_t size() const { return length; }
+
+private:
+    char* text;
+    size_t capacity;
+    size_t length = 0;
+};
+
+Logger::Logger()
+    : min_level(parseLevel(env_string("LOG_LEVEL", ""))),
+      rate_limit(static_cast<uint32_t>(std::max(1LL, env_integer("LOG_RATE_LIMIT", 20)))),
+      output(stderr) {
+    std::string path = env_string("LOG_FILE", "");
+    if (!path.empty()) {
+        output = std::fopen(path.c_str(), "a");
+        if (!output) {
+            std::fprintf(stderr, "Cannot open log file %s, logging to stderr\n", path.c_str());
+            output = stderr;
+        }
+    }
+    drainer = std::thread(&Logger::run, this);
+}
+
+Logger::~Logger() {
+    {
+        std::lock_guard<std::mutex> lock(run_mutex);
+        stopping = true;
+    }
+    run_cv.notify_all();
+    if (drainer.joinable()) drainer.join();
+    drain();
+    if (output != stderr) std::fclose(output);
+}
+
+Logger::Ring& Logger::local() {
+    // El ring vive mientras el logger lo tenga registrado, aunque el hilo termine antes
+    struct Handle {
+        std::shared_ptr<Ring> ring;
+        ~Handle() {
+            if (ring) ring->orphaned.store(true, std::memory_order_release);
+        }
+    };
+    thread_local Handle handle;
+
+    if (!handle.ring) {
+        handle.ring = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        rings.push_back(handle.ring);
+    }
+    return *handle.ring;
+}
+
+void Logger::write(LogLevel level, LogSite& site, std::string_view message, std::initializer_list<LogField> fields) {
+    int64_t now = nowNanoseconds();
+
+    // Ventana de un segundo por punto de llamada; el reinicio es aproximado pero nunca bloquea
+    int64_t second = now / 1000000000;
+    int64_t window = site.window.load(std::memory_order_relaxed);
+    if (window != second && site.window.compare_exchange_strong(window, second, std::memory_order_relaxed))
+        site.count.store(0, std::memory_order_relaxed);
+    if (site.count.fetch_add(1, std::memory_order_relaxed) >= rate_limit) {
+        site.suppressed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Ring& ring = local();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) >= RING_SLOTS) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Slot& slot = ring.slots[head % RING_SLOTS];
+    SlotWriter writer(slot.text, SLOT_TEXT);
+    writer.raw("msg=");
+    writer.value(message);
+    for (const LogField& field : fields) {
+        writer.raw(" ");
+        writer.raw(field.key);
+        writer.raw("=");
+        writer.value(field.value);
+    }
+    uint32_t suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+    if (suppressed) {
+        writer.raw(" suppressed=");
+        writer.raw(std::to_string(suppressed));
+    }
+
+    slot.time_ns = now;
+    slot.level = level;
+    slot.length = static_cast<uint16_t>(writer.size());
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void Logger::drain() {
+    std::lock_guard<std::mutex> drain_lock(drain_mutex);
+    std::vector<std::shared_ptr<Ring>> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        snapshot = rings;
+    }
+
+    std::string batch;
+    char prefix[64];
+    for (const auto& ring : snapshot) {
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        for (; tail < head; ++tail) {
+            const Slot& slot = ring->slots[tail % RING_SLOTS];
+            time_t seconds = slot.time_ns / 1000000000;
+            struct tm utc;
+            gmtime_r(&seconds, &utc);
+            size_t n = std::strftime(prefix, sizeof(prefix), "%Y-%m-%dT%H:%M:%S", &utc);
+            std::snprintf(prefix + n, sizeof(prefix) - n, ".%06lldZ level=%s ",
+                          static_cast<long long>(slot.time_ns % 1000000000 / 1000),
+                          LEVEL_NAMES[static_cast<int>(slot.level)]);
+            batch += prefix;
+            batch.append(slot.text, slot.length);
+            batch += '\n';
+        }
+        ring->tail.store(tail, std::memory_order_release);
+
+        uint64_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped) batch += "level=warn msg=\"log ring full\" dropped=" + std::to_string(dropped) + "\n";
+    }
+
+    if (!batch.empty()) {
+        std::fwrite(batch.data(), 1, batch.size(), output);
+        std::fflush(output);
+    }
+
+    // Rings de hilos terminados que ya están vacíos
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    rings.erase(std::remove_if(rings.begin(), rings.end(), [](const std::shared_ptr<Ring>& ring) {
+        return ring->orphaned.load(std::memory_order_acquire) &&
+               ring->tail.load(std::memory_order_relaxed) == ring->head.load(std::memory_order_acquire);
+    }), rings.end());
+}
+
+void Logger::flush() {
+    drain();
+}
+
+void Logger::run() {
+    std::unique_lock<std::mutex> lock(run_mutex);
+    while (!stopping) {
+        run_cv.wait_for(lock, std::chrono::milliseconds(50));
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+}
+
+Logger& logger() {
+    static Logger instance;
+    return instance;
+}
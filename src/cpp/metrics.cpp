@@ -0,0 +1,268 @@
+#include "../metrics.h"
+#include "../env_loader.h"
+#include <cstdio>
+#include <sstream>
+
+struct RouteTemplate {
+    crow::HTTPMethod method;
+    const char* method_name;
+    const char* path;
+};
+
+// Las mismas rutas que setup_routes; lo que no encaja se cuenta como "other"
+static const RouteTemplate ROUTES[] = {
+    {crow::HTTPMethod::Get, "GET", "/token/<int>"},
+    {crow::HTTPMethod::Get, "GET", "/Mangas/<string>/<string>/<int>/<int>"},
+    {crow::HTTPMethod::Post, "POST", "/Mangas/<string>/<string>/<int>/<int>"},
+    {crow::HTTPMethod::Get, "GET", "/Mangas/<string>/<string>/<int>"},
+    {crow::HTTPMethod::Post, "POST", "/Mangas/<string>/<string>/<int>"},
+    {crow::HTTPMethod::Post, "POST", "/Mangas/<string>/<string>/<int>/seal"},
+    {crow::HTTPMethod::Get, "GET", "/Media/Profiles/<string>/Posts/<string>/<int>"},
+    {crow::HTTPMethod::Post, "POST", "/Media/Profiles/<string>/Posts/<string>/<int>"},
+    {crow::HTTPMethod::Get, "GET", "/Media/Profiles/<string>/Groups/<string>/<int>"},
+    {crow::HTTPMethod::Post, "POST", "/Media/Profiles/<string>/Groups/<string>/<int>"},
+    {crow::HTTPMethod::Get, "GET", "/Media/Profiles/<string>/<string>"},
+    {crow::HTTPMethod::Post, "POST", "/Media/Profiles/<string>/<string>"},
+    {crow::HTTPMethod::Get, "GET", "/Media/Website/<string>/<string>"},
+    {crow::HTTPMethod::Post, "POST", "/metadata"},
+    {crow::HTTPMethod::Get, "GET", "/stats/cache"},
+    {crow::HTTPMethod::Get, "GET", "/stats/index"},
+    {crow::HTTPMethod::Get, "GET", "/metrics"},
+    {crow::HTTPMethod::Get, "GET", "/beep"},
+};
+static constexpr size_t KNOWN_ROUTES = sizeof(ROUTES) / sizeof(ROUTES[0]);
+
+static const int STATUSES[] = {200, 201, 206, 304, 400, 401, 403, 404, 405, 413, 416, 429, 500, 502, 503};
+static constexpr size_t KNOWN_STATUSES = sizeof(STATUSES) / sizeof(STATUSES[0]);
+
+// Límites superiores de los buckets en segundos, de 10 µs a 5 s
+static const double BUCKET_BOUNDS[] = {
+    0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+    0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5
+};
+
+static const char* PHASE_NAMES[] = {"encrypt_token", "redis", "redis_pool_wait", "disk_open", "disk_read", "disk_write"};
+
+// Nombre de la métrica (sin el sufijo _total) y su ayuda
+static const struct {
+    const char* name;
+    const char* help;
+} COUNTERS[] = {
+    {"pdfast_redis_errors", "Redis calls that failed (connection, timeout or reply errors)."},
+    {"pdfast_redis_pool_timeouts", "Redis calls rejected after waiting REDIS_POOL_WAIT_MS for a connection."},
+    {"pdfast_admission_overloaded", "Requests answered 503 because their class was at its in-flight limit."},
+    {"pdfast_admission_rate_limited", "Requests answered 429 because their session or client ran out of tokens."},
+    {"pdfast_prefetch_pages", "Chapter pages warmed ahead of the reader."},
+    {"pdfast_prefetch_hits", "Warmed pages requested before PREFETCH_TTL."},
+    {"pdfast_prefetch_wasted", "Warmed pages nobody requested within PREFETCH_TTL."},
+    {"pdfast_prefetch_budget_exhausted", "Read-ahead stopped early because the client used its PREFETCH_HOST_BUDGET."},
+};
+
+Metrics::Metrics(size_t shard_count) {
+    static_assert(KNOWN_ROUTES + 1 == ROUTE_COUNT, "ROUTE_COUNT must cover every route plus \"other\"");
+    static_assert(KNOWN_STATUSES + 1 == STATUS_COUNT, "STATUS_COUNT must cover every status plus \"other\"");
+    static_assert(sizeof(BUCKET_BOUNDS) / sizeof(BUCKET_BOUNDS[0]) == BUCKET_COUNT, "BUCKET_COUNT mismatch");
+    static_assert(sizeof(PHASE_NAMES) / sizeof(PHASE_NAMES[0]) == PHASE_COUNT, "PHASE_COUNT mismatch");
+    static_assert(sizeof(COUNTERS) / sizeof(COUNTERS[0]) == COUNTER_COUNT, "COUNTER_COUNT mismatch");
+
+    if (shard_count == 0) shard_count = 1;
+    shards.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i)
+        shards.push_back(std::make_unique<Shard>());
+}
+
+Metrics::Shard& Metrics::local() {
+    // Cada hilo se queda con un shard fijo la primera vez que registra algo
+    thread_local size_t index = next_shard.fetch_add(1, std::memory_order_relaxed);
+    return *shards[index % shards.size()];
+}
+
+void Metrics::Histogram::observe(uint64_t nanoseconds) {
+    double seconds = nanoseconds / 1e9;
+    size_t bucket = 0;
+    while (bucket < BUCKET_COUNT && seconds > BUCKET_BOUNDS[bucket]) ++bucket;
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    sum_ns.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+size_t Metrics::routeFor(crow::HTTPMethod method, const std::string& url) {
+    for (size_t route = 0; route < KNOWN_ROUTES; ++route) {
+        if (ROUTES[route].method != method) continue;
+
+        const char* pattern = ROUTES[route].path;
+        size_t pos = 0;
+        bool matched = true;
+        while (matched && *pattern) {
+            if (*pattern == '<') {
+                bool integer = pattern[1] == 'i';
+                while (*pattern && *pattern != '>') ++pattern;
+                if (*pattern) ++pattern;
+
+                size_t end = url.find('/', pos);
+                if (end == std::string::npos) end = url.size();
+                if (end == pos) matched = false;
+                for (size_t i = pos; integer && matched && i < end; ++i)
+                    matched = url[i] >= '0' && url[i] <= '9';
+                pos = end;
+            } else {
+                matched = pos < url.size() && url[pos] == *pattern;
+                ++pos;
+                ++pattern;
+            }
+        }
+        if (matched && pos == url.size()) return route;
+    }
+    return KNOWN_ROUTES;
+}
+
+size_t Metrics::statusIndex(int status) {
+    for (size_t i = 0; i < KNOWN_STATUSES; ++i)
+        if (STATUSES[i] == status) return i;
+    return KNOWN_STATUSES;
+}
+
+void Metrics::recordRequest(crow::HTTPMethod method, const std::string& url, int status,
+                            uint64_t nanoseconds, uint64_t bytes_in, uint64_t bytes_out) {
+    size_t route = routeFor(method, url);
+    Shard& shard = local();
+    shard.requests[route][statusIndex(status)].fetch_add(1, std::memory_order_relaxed);
+    shard.latency[route].observe(nanoseconds);
+    shard.bytes_in[route].fetch_add(bytes_in, std::memory_order_relaxed);
+    shard.bytes_out[route].fetch_add(bytes_out, std::memory_order_relaxed);
+}
+
+void Metrics::recordPhase(Phase phase, uint64_t nanoseconds) {
+    local().phases[static_cast<size_t>(phase)].observe(nanoseconds);
+}
+
+void Metrics::count(Counter counter, uint64_t amount) {
+    local().counters[static_cast<size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+}
+
+static std::string formatSeconds(double seconds) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.9g", seconds);
+    return buffer;
+}
+
+template <size_t N>
+static void writeHistogram(std::ostringstream& out, const std::string& name, const std::string& labels,
+                           const std::array<uint64_t, N>& buckets, uint64_t sum_ns) {
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        cumulative += buckets[i];
+        std::string le = i + 1 < buckets.size() ? formatSeconds(BUCKET_BOUNDS[i]) : "+Inf";
+        out << name << "_bucket{" << labels << ",le=\"" << le << "\"} " << cumulative << '\n';
+    }
+    out << name << "_sum{" << labels << "} " << formatSeconds(sum_ns / 1e9) << '\n';
+    out << name << "_count{" << labels << "} " << cumulative << '\n';
+}
+
+std::string Metrics::render() const {
+    using Buckets = std::array<uint64_t, BUCKET_COUNT + 1>;
+
+    // Suma de todos los shards; los valores pueden ir ligeramente desfasados entre sí, nunca hacia atrás
+    std::array<std::array<uint64_t, STATUS_COUNT>, ROUTE_COUNT> requests{};
+    std::array<Buckets, ROUTE_COUNT> latency{};
+    std::array<uint64_t, ROUTE_COUNT> latency_sum{}, bytes_in{}, bytes_out{};
+    std::array<Buckets, PHASE_COUNT> phases{};
+    std::array<uint64_t, PHASE_COUNT> phase_sum{};
+    std::array<uint64_t, COUNTER_COUNT> counters{};
+
+    auto addHistogram = [](const Histogram& histogram, Buckets& buckets, uint64_t& sum) {
+        for (size_t i = 0; i < buckets.size(); ++i)
+            buckets[i] += histogram.buckets[i].load(std::memory_order_relaxed);
+        sum += histogram.sum_ns.load(std::memory_order_relaxed);
+    };
+
+    for (const auto& shard : shards) {
+        for (size_t route = 0; route < ROUTE_COUNT; ++route) {
+            for (size_t status = 0; status < STATUS_COUNT; ++status)
+                requests[route][status] += shard->requests[route][status].load(std::memory_order_relaxed);
+            addHistogram(shard->latency[route], latency[route], latency_sum[route]);
+            bytes_in[route] += shard->bytes_in[route].load(std::memory_order_relaxed);
+            bytes_out[route] += shard->bytes_out[route].load(std::memory_order_relaxed);
+        }
+        for (size_t phase = 0; phase < PHASE_COUNT; ++phase)
+            addHistogram(shard->phases[phase], phases[phase], phase_sum[phase]);
+        for (size_t counter = 0; counter < COUNTER_COUNT; ++counter)
+            counters[counter] += shard->counters[counter].load(std::memory_order_relaxed);
+    }
+
+    auto routeLabels = [](size_t route) {
+        if (route == KNOWN_ROUTES) return std::string("method=\"other\",route=\"other\"");
+        return std::string("method=\"") + ROUTES[route].method_name + "\",route=\"" + ROUTES[route].path + "\"";
+    };
+
+    std::ostringstream out;
+    out << "# HELP pdfast_http_requests_total Requests handled by route and status code.\n"
+        << "# TYPE pdfast_http_requests_total counter\n";
+    for (size_t route = 0; route < ROUTE_COUNT; ++route) {
+        for (size_t status = 0; status < STATUS_COUNT; ++status) {
+            if (!requests[route][status]) continue;
+            std::string code = status < KNOWN_STATUSES ? std::to_string(STATUSES[status]) : "other";
+            out << "pdfast_http_requests_total{" << routeLabels(route) << ",code=\"" << code << "\"} "
+                << requests[route][status] << '\n';
+        }
+    }
+
+    out << "# HELP pdfast_http_request_duration_seconds Time from routing to the end of the handler.\n"
+        << "# TYPE pdfast_http_request_duration_seconds histogram\n";
+    for (size_t route = 0; route < ROUTE_COUNT; ++route) {
+        uint64_t count = 0;
+        for (uint64_t bucket : latency[route]) count += bucket;
+        if (count) writeHistogram(out, "pdfast_http_request_duration_seconds", routeLabels(route),
+                                  latency[route], latency_sum[route]);
+    }
+
+    out << "# HELP pdfast_http_request_bytes_total Bytes received in request bodies.\n"
+        << "# TYPE pdfast_http_request_bytes_total counter\n";
+    for (size_t route = 0; route < ROUTE_COUNT; ++route)
+        if (bytes_in[route]) out << "pdfast_http_request_bytes_total{" << routeLabels(route) << "} " << bytes_in[route] << '\n';
+
+    out << "# HELP pdfast_http_response_bytes_total Bytes sent in response bodies.\n"
+        << "# TYPE pdfast_http_response_bytes_total counter\n";
+    for (size_t route = 0; route < ROUTE_COUNT; ++route)
+        if (bytes_out[route]) out << "pdfast_http_response_bytes_total{" << routeLabels(route) << "} " << bytes_out[route] << '\n';
+
+    out << "# HELP pdfast_phase_duration_seconds Time spent in token digests, Redis calls and disk I/O.\n"
+        << "# TYPE pdfast_phase_duration_seconds histogram\n";
+    for (size_t phase = 0; phase < PHASE_COUNT; ++phase)
+        writeHistogram(out, "pdfast_phase_duration_seconds", std::string("phase=\"") + PHASE_NAMES[phase] + "\"",
+                       phases[phase], phase_sum[phase]);
+
+    for (size_t counter = 0; counter < COUNTER_COUNT; ++counter) {
+        out << "# HELP " << COUNTERS[counter].name << "_total " << COUNTERS[counter].help << '\n'
+            << "# TYPE " << COUNTERS[counter].name << "_total counter\n"
+            << COUNTERS[counter].name << "_total " << counters[counter] << '\n';
+    }
+
+    return out.str();
+}
+
+Metrics& metrics() {
+    static Metrics instance(static_cast<size_t>(env_integer("METRICS_SHARDS", 32)));
+    return instance;
+}
+
+PhaseTimer::~PhaseTimer() {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    metrics().recordPhase(phase, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+void MetricsMiddleware::before_handle(crow::request&, crow::response&, context& ctx) {
+    ctx.start = std::chrono::steady_clock::now();
+}
+
+void MetricsMiddleware::after_handle(crow::request& req, crow::response& res, context& ctx) {
+    auto elapsed = std::chrono::steady_clock::now() - ctx.start;
+
+    // Los archivos servidos desde disco por Crow no pasan por res.body
+    uint64_t bytes_out = res.body.size();
+    if (!res.file_info.path.empty() && res.file_info.statResult == 0)
+        bytes_out = res.file_info.statbuf.st_size;
+
+    metrics().recordRequest(req.method, req.url, res.code,
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                            req.body.size(), bytes_out);
+}
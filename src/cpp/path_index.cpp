@@ -0,0 +1,370 @@
+#include "../path_index.h"
+#include "../env_loader.h"
+#include "../logger.h"
+#include "../storage_layout.h"
+#include <filesystem>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const std::unordered_set<std::string> VALID_EXTENSIONS = {
+    "jpg", "jpeg", "png", "webp", "gif", "bmp", "tiff", "mp4"
+};
+
+static const uint32_t WATCH_MASK = IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                                   IN_DELETE | IN_DELETE_SELF | IN_ONLYDIR;
+
+static bool isHidden(const std::string& name) {
+    // El árbol del layout por hash es oculto para las rutas, pero el índice lo recorre
+    return !name.empty() && name[0] == '.' && name != StorageLayout::SHARD_DIR;
+}
+
+PathIndex::PathIndex(size_t shard_count) {
+    if (shard_count == 0) shard_count = 1;
+    shards.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i)
+        shards.push_back(std::make_unique<Shard>());
+}
+
+PathIndex::~PathIndex() {
+    stopping = true;
+    if (watcher.joinable()) watcher.join();
+    if (inotify_fd >= 0) close(inotify_fd);
+}
+
+std::string PathIndex::keyFor(const std::string& path, std::string* extension) {
+    size_t slash = path.find_last_of('/');
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        if (extension) extension->clear();
+        return StorageLayout::logical(path);
+    }
+    if (extension) *extension = path.substr(dot + 1);
+    // La clave es lógica: el mismo archivo tiene la misma clave en cualquier layout
+    return StorageLayout::logical(path.substr(0, dot));
+}
+
+PathIndex::Shard& PathIndex::shardFor(const std::string& key) {
+    return *shards[std::hash<std::string>{}(key) % shards.size()];
+}
+
+void PathIndex::start(const std::vector<std::string>& roots, size_t threads) {
+    this->roots = roots;
+    scan_threads = threads ? threads : 1;
+
+    inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotify_fd < 0) {
+        LOG_WARN("inotify unavailable, the path index will not be authoritative");
+        watch_failed = true;
+    }
+
+    // Primero se vigila y después se escanea, así ningún cambio queda entre ambos
+    for (const auto& root : roots) {
+        std::error_code ec;
+        std::filesystem::create_directories(root, ec);
+        if (inotify_fd >= 0) watchTree(root);
+    }
+    scan(roots, scan_threads);
+    is_authoritative = !watch_failed;
+
+    if (inotify_fd >= 0) watcher = std::thread(&PathIndex::watchLoop, this);
+}
+
+void PathIndex::scan(const std::vector<std::string>& roots, size_t threads) {
+    // Cada subdirectorio de primer nivel (un usuario) es una unidad de trabajo
+    std::vector<std::string> work;
+    for (const auto& root : roots) {
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(root, ec)) {
+            std::string name = entry.path().filename().string();
+            if (isHidden(name)) continue;
+            if (name == StorageLayout::SHARD_DIR) {
+                // Cada directorio de primer nivel del layout por hash es una unidad de trabajo
+                for (const auto& shard : std::filesystem::directory_iterator(entry.path(), ec))
+                    if (shard.is_directory(ec)) work.push_back(shard.path().generic_string());
+            } else if (entry.is_directory(ec)) {
+                work.push_back(entry.path().generic_string());
+            } else if (entry.is_regular_file(ec)) {
+                struct stat st;
+                if (stat(entry.path().c_str(), &st) == 0)
+                    record(entry.path().generic_string(), st.st_size, st.st_mtim.tv_sec, false);
+            }
+        }
+    }
+
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < std::min(threads, work.size()); ++i) {
+        workers.emplace_back([&] {
+            for (size_t item = next++; item < work.size(); item = next++)
+                scanDirectory(work[item]);
+        });
+    }
+    for (auto& worker : workers) worker.join();
+}
+
+void PathIndex::scanDirectory(const std::string& directory) {
+    std::error_code ec;
+    std::filesystem::recursive_directory_iterator it(directory, ec), end;
+    for (; !ec && it != end; it.increment(ec)) {
+        if (isHidden(it->path().filename().string())) {
+            if (it->is_directory(ec)) it.disable_recursion_pending();
+            continue;
+        }
+        if (!it->is_regular_file(ec)) continue;
+
+        struct stat st;
+        if (stat(it->path().c_str(), &st) == 0)
+            record(it->path().generic_string(), st.st_size, st.st_mtim.tv_sec, false);
+    }
+}
+
+void PathIndex::record(const std::string& path, uintmax_t size, time_t mtime, bool replace) {
+    std::string extension;
+    std::string key = keyFor(path, &extension);
+    Shard& shard = shardFor(key);
+    std::unique_lock lock(shard.mutex);
+
+    auto it = shard.files.find(key);
+    if (it == shard.files.end()) {
+        shard.files.emplace(key, IndexedFile{path, extension, size, mtime});
+        entries.fetch_add(1, std::memory_order_relaxed);
+        addChild(path);
+        return;
+    }
+    // Si existen varias extensiones para la misma página gana la más reciente
+    if (replace || it->second.path == path || mtime >= it->second.mtime) {
+        if (it->second.path != path) {
+            dropChild(it->second.path);
+            addChild(path);
+        }
+        it->second = IndexedFile{path, extension, size, mtime};
+    }
+}
+
+void PathIndex::addChild(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::lock_guard<std::mutex> lock(tree_mutex);
+    children[path.substr(0, slash == std::string::npos ? 0 : slash)].insert(path.substr(slash + 1));
+}
+
+void PathIndex::dropChild(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::lock_guard<std::mutex> lock(tree_mutex);
+    auto it = children.find(path.substr(0, slash == std::string::npos ? 0 : slash));
+    if (it == children.end()) return;
+    it->second.erase(path.substr(slash + 1));
+    if (it->second.empty()) children.erase(it);
+}
+
+std::optional<IndexedFile> PathIndex::lookup(const std::string& key) {
+    Shard& shard = shardFor(key);
+    std::shared_lock lock(shard.mutex);
+
+    auto it = shard.files.find(key);
+    if (it != shard.files.end()) {
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return it->second;
+    }
+    if (is_authoritative.load(std::memory_order_acquire))
+        negative_hits.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+}
+
+bool PathIndex::authoritative() const {
+    return is_authoritative.load(std::memory_order_acquire);
+}
+
+void PathIndex::update(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        remove(path);
+        return;
+    }
+    record(path, st.st_size, st.st_mtim.tv_sec, true);
+}
+
+void PathIndex::remove(const std::string& path) {
+    std::string key = keyFor(path);
+    {
+        Shard& shard = shardFor(key);
+        std::unique_lock lock(shard.mutex);
+
+        auto it = shard.files.find(key);
+        if (it == shard.files.end() || it->second.path != path) return;
+        shard.files.erase(it);
+        entries.fetch_sub(1, std::memory_order_relaxed);
+        dropChild(path);
+    }
+
+    // Otra extensión de la misma página puede seguir en disco: sin ella el índice daría un 404 falso
+    size_t slash = key.find_last_of('/');
+    if (slash == std::string::npos) return;
+    std::string name = key.substr(slash + 1);
+    for (const std::string& directory : storage_layout().directories(key.substr(0, slash))) {
+        for (const std::string& extension : VALID_EXTENSIONS) {
+            std::string sibling = directory + "/" + name + "." + extension;
+            struct stat st;
+            if (sibling != path && stat(sibling.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+                record(sibling, st.st_size, st.st_mtim.tv_sec, false);
+        }
+    }
+}
+
+void PathIndex::removePrefix(const std::string& prefix) {
+    // Solo se visitan los directorios del subárbol: publicar un capítulo no recorre el índice entero
+    std::vector<std::string> paths;
+    {
+        std::lock_guard<std::mutex> lock(tree_mutex);
+        auto collect = [&](std::map<std::string, std::unordered_set<std::string>>::iterator it) {
+            for (const std::string& name : it->second) paths.push_back(it->first + "/" + name);
+            return children.erase(it);
+        };
+        auto own = children.find(prefix.substr(0, prefix.size() - 1));
+        if (own != children.end()) collect(own);
+        // Todo lo que empieza por "dir/" es contiguo en el orden del map
+        for (auto it = children.lower_bound(prefix);
+             it != children.end() && it->first.compare(0, prefix.size(), prefix) == 0;)
+            it = collect(it);
+    }
+
+    for (const std::string& path : paths) {
+        Shard& shard = shardFor(keyFor(path));
+        std::unique_lock lock(shard.mutex);
+        auto it = shard.files.find(keyFor(path));
+        if (it == shard.files.end() || it->second.path != path) continue;
+        shard.files.erase(it);
+        entries.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void PathIndex::countFallback() {
+    fallbacks.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PathIndex::rescan() {
+    is_authoritative = false;
+    rescans.fetch_add(1, std::memory_order_relaxed);
+    for (auto& shard : shards) {
+        std::unique_lock lock(shard->mutex);
+        entries.fetch_sub(shard->files.size(), std::memory_order_relaxed);
+        shard->files.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(tree_mutex);
+        children.clear();
+    }
+    scan(roots, scan_threads);
+    is_authoritative = !watch_failed;
+}
+
+void PathIndex::watchTree(const std::string& directory) {
+    int wd = inotify_add_watch(inotify_fd, directory.c_str(), WATCH_MASK);
+    if (wd < 0) {
+        if (!watch_failed.exchange(true))
+            LOG_WARN("Cannot watch directory, raise fs.inotify.max_user_watches", {"directory", directory});
+        is_authoritative = false;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(watches_mutex);
+        watches[wd] = directory;
+    }
+
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        if (entry.is_directory(ec) && !isHidden(entry.path().filename().string()))
+            watchTree(entry.path().generic_string());
+    }
+}
+
+void PathIndex::unwatchTree(const std::string& directory) {
+    // Los watches del árbol movido seguirían apuntando a la ruta antigua
+    std::string prefix = directory + "/";
+    std::lock_guard<std::mutex> lock(watches_mutex);
+    for (auto it = watches.begin(); it != watches.end();) {
+        if (it->second == directory || it->second.compare(0, prefix.size(), prefix) == 0) {
+            inotify_rm_watch(inotify_fd, it->first);
+            it = watches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void PathIndex::watchLoop() {
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    pollfd pfd{inotify_fd, POLLIN, 0};
+
+    while (!stopping) {
+        if (poll(&pfd, 1, 500) <= 0) continue;
+        ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0) continue;
+
+        bool lost_events = false;
+        for (char* ptr = buffer; ptr < buffer + length;) {
+            auto* event = reinterpret_cast<struct inotify_event*>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                lost_events = true;
+                continue;
+            }
+
+            std::string directory;
+            {
+                std::lock_guard<std::mutex> lock(watches_mutex);
+                auto it = watches.find(event->wd);
+                if (it == watches.end()) continue;
+                if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+                    watches.erase(it);
+                    continue;
+                }
+                directory = it->second;
+            }
+
+            std::string name = event->len ? event->name : "";
+            if (name.empty() || isHidden(name)) continue;
+            std::string path = directory + "/" + name;
+
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    watchTree(path);
+                    scanDirectory(path);
+                } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    unwatchTree(path);
+                    removePrefix(path + "/");
+                    // Un rename que intercambia directorios deja otro árbol en la misma ruta
+                    std::error_code ec;
+                    if (std::filesystem::is_directory(path, ec)) {
+                        watchTree(path);
+                        scanDirectory(path);
+                    }
+                }
+            } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                update(path);
+            } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                remove(path);
+            }
+        }
+
+        if (lost_events) rescan();
+    }
+}
+
+PathIndexStats PathIndex::stats() const {
+    return {
+        entries.load(std::memory_order_relaxed),
+        hits.load(std::memory_order_relaxed),
+        negative_hits.load(std::memory_order_relaxed),
+        fallbacks.load(std::memory_order_relaxed),
+        rescans.load(std::memory_order_relaxed),
+        authoritative()
+    };
+}
+
+PathIndex& path_index() {
+    static PathIndex index(static_cast<size_t>(env_integer("PATH_INDEX_SHARDS", 32)));
+    return index;
+}
@@ -0,0 +1,126 @@
+#include "../prefetch.h"
+#include "../config.h"
+#include "../file_cache.h"
+#include "../metrics.h"
+#include "../path_index.h"
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <functional>
+#include <unistd.h>
+
+static int64_t nowSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Prefetcher::Shard& Prefetcher::shardFor(const std::string& key) {
+    return shards[std::hash<std::string>{}(key) % SHARD_COUNT];
+}
+
+void Prefetcher::refund(const std::string& client, uintmax_t size) {
+    std::lock_guard<std::mutex> lock(budget_mutex);
+    auto it = outstanding.find(client);
+    if (it == outstanding.end()) return;
+    it->second -= std::min(it->second, size);
+    if (it->second == 0) outstanding.erase(it);
+}
+
+void Prefetcher::served(const std::string& key) {
+    Warmed warmed;
+    {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.pages.find(key);
+        if (it == shard.pages.end()) return;
+        warmed = std::move(it->second);
+        shard.pages.erase(it);
+    }
+    metrics().count(Counter::PrefetchHits);
+    refund(warmed.client, warmed.size);
+}
+
+void Prefetcher::expire(int64_t now, int64_t ttl) {
+    std::vector<Warmed> wasted;
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        std::erase_if(shard.pages, [&](auto& entry) {
+            if (now - entry.second.warmed_at < ttl) return false;
+            wasted.push_back(std::move(entry.second));
+            return true;
+        });
+    }
+
+    // Páginas calentadas que nadie pidió a tiempo: cuentan contra la ventana y liberan el presupuesto
+    if (!wasted.empty()) metrics().count(Counter::PrefetchWasted, wasted.size());
+    for (const Warmed& warmed : wasted) refund(warmed.client, warmed.size);
+}
+
+std::vector<PrefetchPage> Prefetcher::plan(const std::string& client, const std::string& chapter_key, int page) {
+    const Config& settings = config();
+    std::vector<PrefetchPage> planned;
+    if (settings.prefetch_window == 0 || settings.prefetch_host_budget == 0) return planned;
+
+    int64_t now = nowSeconds();
+    bool sweep;
+    {
+        std::lock_guard<std::mutex> lock(budget_mutex);
+        sweep = now != last_expiry;
+        if (sweep) last_expiry = now;
+    }
+    if (sweep) expire(now, settings.prefetch_ttl);
+
+    FileCache& cache = hot_file_cache();
+    FileCacheStats cache_stats = cache.stats();
+    uintmax_t cache_free = cache_stats.capacity_bytes - std::min(cache_stats.bytes, cache_stats.capacity_bytes);
+
+    for (size_t ahead = 1; ahead <= settings.prefetch_window; ++ahead) {
+        std::string key = chapter_key + "/" + std::to_string(page + static_cast<int>(ahead));
+        // Solo páginas que el índice ya conoce: la lectura anticipada nunca sondea el disco.
+        // La primera que falta es el final del capítulo
+        std::optional<IndexedFile> file = path_index().lookup(key);
+        if (!file) break;
+        if (cache.contains(file->path)) continue;
+
+        {
+            std::lock_guard<std::mutex> lock(budget_mutex);
+            uintmax_t& used = outstanding[client];
+            if (used + file->size > settings.prefetch_host_budget) {
+                if (used == 0) outstanding.erase(client);
+                metrics().count(Counter::PrefetchBudgetExhausted);
+                break;
+            }
+            used += file->size;
+        }
+
+        {
+            Shard& shard = shardFor(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (!shard.pages.try_emplace(key, Warmed{client, file->size, now}).second) {
+                // Otra petición ya la está calentando
+                refund(client, file->size);
+                continue;
+            }
+        }
+
+        // Sin sitio libre en la caché se deja en la caché de páginas del kernel
+        bool fits = cache.admits(file->size) && file->size <= cache_free;
+        if (fits) cache_free -= file->size;
+        metrics().count(Counter::PrefetchPages);
+        planned.push_back({file->path, file->size, fits});
+    }
+    return planned;
+}
+
+void Prefetcher::adviseWillNeed(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    // El kernel empieza la lectura en segundo plano y vuelve enseguida
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    ::close(fd);
+}
+
+Prefetcher& prefetcher() {
+    static Prefetcher instance;
+    return instance;
+}
@@ -0,0 +1,217 @@
+#include "../storage_layout.h"
+#include "../atomic_file.h"
+#include "../env_loader.h"
+#include "../logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+static const std::string SHARD_PREFIX = std::string(StorageLayout::SHARD_DIR) + "/";
+
+// FNV-1a de 64 bits: estable entre compilaciones y plataformas, a diferencia de std::hash
+static uint64_t fnv1a(const std::string& value) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : value) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool isHidden(const std::string& name) {
+    return !name.empty() && name[0] == '.';
+}
+
+static std::string directoryOf(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+StorageLayout::StorageLayout(LayoutMode mode) : layout_mode(mode) {}
+
+bool StorageLayout::shardable(const std::string& logical_dir) {
+    size_t slash = logical_dir.find('/');
+    if (slash == std::string::npos || slash + 1 == logical_dir.size()) return false;
+
+    std::string rest = logical_dir.substr(slash + 1);
+    if (rest == SHARD_DIR || rest.rfind(SHARD_PREFIX, 0) == 0) return false;
+    // Los assets del sitio son pocos y tienen su propia ruta
+    return logical_dir != "Media/Website" && logical_dir.rfind("Media/Website/", 0) != 0;
+}
+
+std::string StorageLayout::shardedDirectory(const std::string& logical_dir) {
+    if (!shardable(logical_dir)) return logical_dir;
+
+    uint64_t hash = fnv1a(logical_dir);
+    char shard[8];
+    snprintf(shard, sizeof(shard), "%02x/%02x", static_cast<unsigned>((hash >> 8) & 0xff),
+             static_cast<unsigned>(hash & 0xff));
+
+    size_t slash = logical_dir.find('/');
+    return logical_dir.substr(0, slash + 1) + SHARD_PREFIX + shard + logical_dir.substr(slash);
+}
+
+std::string StorageLayout::logical(const std::string& physical) {
+    // <root>/.shards/xx/yy/<resto> -> <root>/<resto>
+    size_t slash = physical.find('/');
+    if (slash == std::string::npos || physical.compare(slash + 1, SHARD_PREFIX.size(), SHARD_PREFIX) != 0)
+        return physical;
+    size_t shard = slash + 1 + SHARD_PREFIX.size();
+    if (physical.size() <= shard + 6 || physical[shard + 2] != '/' || physical[shard + 5] != '/') return physical;
+    return physical.substr(0, slash + 1) + physical.substr(shard + 6);
+}
+
+std::string StorageLayout::directory(const std::string& logical_dir) const {
+    return layout_mode == LayoutMode::Sharded ? shardedDirectory(logical_dir) : logical_dir;
+}
+
+std::string StorageLayout::place(const std::string& logical_path) const {
+    size_t slash = logical_path.find_last_of('/');
+    if (slash == std::string::npos) return logical_path;
+    return directory(logical_path.substr(0, slash)) + logical_path.substr(slash);
+}
+
+std::vector<std::string> StorageLayout::directories(const std::string& logical_dir) const {
+    std::vector<std::string> found = {directory(logical_dir)};
+    std::string other = layout_mode == LayoutMode::Sharded ? logical_dir : shardedDirectory(logical_dir);
+    if (other != found.front()) found.push_back(other);
+    return found;
+}
+
+std::vector<std::string> StorageLayout::places(const std::string& logical_path) const {
+    size_t slash = logical_path.find_last_of('/');
+    if (slash == std::string::npos) return {logical_path};
+    std::vector<std::string> found = directories(logical_path.substr(0, slash));
+    for (std::string& dir : found) dir += logical_path.substr(slash);
+    return found;
+}
+
+StorageLayout& storage_layout() {
+    static StorageLayout layout(env_string("STORAGE_LAYOUT", "flat") == "sharded" ? LayoutMode::Sharded
+                                                                                  : LayoutMode::Flat);
+    return layout;
+}
+
+// ────────────────────────
+//      Migration
+// ────────────────────────
+
+// Enlaza from en to sin reemplazar nunca lo que haya: 0, -EEXIST si to ya existe, o -errno
+static int linkInto(const std::string& from, const std::string& to) {
+    std::string temp = atomic_temp_path(to);
+    if (::link(from.c_str(), temp.c_str()) != 0) {
+        if (errno != ENOENT) return -errno;
+        std::error_code ec;
+        std::filesystem::create_directories(directoryOf(to), ec);
+        if (::link(from.c_str(), temp.c_str()) != 0) return -errno;
+    }
+
+    // Desde el rename el índice del servidor ve el archivo nuevo (IN_MOVED_TO)
+    int result = ::renameat2(AT_FDCWD, temp.c_str(), AT_FDCWD, to.c_str(), RENAME_NOREPLACE) == 0 ? 0 : -errno;
+    if (result == -EINVAL) {
+        // Sistemas de archivos sin RENAME_NOREPLACE
+        struct stat st;
+        result = ::stat(to.c_str(), &st) == 0 ? -EEXIST : (std::rename(temp.c_str(), to.c_str()) == 0 ? 0 : -errno);
+    }
+    if (result != 0) ::unlink(temp.c_str());
+    return result;
+}
+
+LayoutMigrationStats migrate_layout(const std::vector<std::string>& roots, const StorageLayout& layout,
+                                    std::chrono::milliseconds grace, bool dry_run) {
+    LayoutMigrationStats stats{};
+    // Copias antiguas que se borran cuando pasa el período de gracia
+    std::deque<std::pair<std::chrono::steady_clock::time_point, std::string>> retired;
+
+    auto unlinkRetired = [&](bool all) {
+        auto now = std::chrono::steady_clock::now();
+        while (!retired.empty() && (all || now - retired.front().first >= grace)) {
+            if (all && now - retired.front().first < grace) {
+                std::this_thread::sleep_for(grace - (now - retired.front().first));
+                now = std::chrono::steady_clock::now();
+            }
+            ::unlink(retired.front().second.c_str());
+            retired.pop_front();
+        }
+    };
+
+    auto move = [&](const std::string& from, const std::string& to) {
+        if (dry_run) {
+            ++stats.moved;
+            return;
+        }
+        int result = linkInto(from, to);
+        if (result == 0) ++stats.moved;
+        else if (result == -EEXIST) ++stats.superseded;  // Lo escrito en el layout nuevo gana
+        else if (result == -ENOENT) return;              // Borrado o reemplazado mientras tanto
+        else {
+            ++stats.failed;
+            LOG_WARN("Layout migration failed", {"path", from}, {"error", std::strerror(-result)});
+            return;
+        }
+        retired.emplace_back(std::chrono::steady_clock::now(), from);
+    };
+
+    for (const std::string& root : roots) {
+        std::string shards = root + "/" + StorageLayout::SHARD_DIR;
+        auto sharded = [&](const std::string& dir) { return dir == shards || dir.rfind(shards + "/", 0) == 0; };
+        // Directorios del layout anterior, que quedan vacíos y se eliminan al final
+        auto legacy = [&](const std::string& dir) {
+            if (layout.mode() == LayoutMode::Flat) return sharded(dir);
+            return !sharded(dir) && StorageLayout::shardable(dir);
+        };
+
+        // Primero se listan los directorios: mover mientras se recorre confundiría al iterador
+        std::vector<std::string> directories;
+        std::error_code ec;
+        std::filesystem::recursive_directory_iterator it(root, ec), end;
+        for (; !ec && it != end; it.increment(ec)) {
+            if (!it->is_directory(ec)) continue;
+            std::string dir = it->path().generic_string();
+            if (isHidden(it->path().filename().string()) && dir != shards) {
+                it.disable_recursion_pending();
+                continue;
+            }
+            directories.push_back(dir);
+        }
+
+        for (const std::string& dir : directories) {
+            std::string target = layout.directory(StorageLayout::logical(dir));
+            if (target == dir || dir == shards) continue;
+
+            for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+                std::string name = entry.path().filename().string();
+                if (!isHidden(name) && entry.is_regular_file(ec)) move(dir + "/" + name, target + "/" + name);
+            }
+            // Las variantes se mueven con su original y siguen siendo válidas: el rename conserva el mtime
+            for (const auto& entry : std::filesystem::directory_iterator(dir + "/.variants", ec)) {
+                std::string name = entry.path().filename().string();
+                if (!isHidden(name) && entry.is_regular_file(ec))
+                    move(dir + "/.variants/" + name, target + "/.variants/" + name);
+            }
+            unlinkRetired(false);
+        }
+        unlinkRetired(true);
+        if (dry_run) continue;
+
+        // Del más profundo al más superficial: solo se borran los que quedaron vacíos
+        std::sort(directories.begin(), directories.end(), [](const std::string& a, const std::string& b) {
+            return std::count(a.begin(), a.end(), '/') > std::count(b.begin(), b.end(), '/');
+        });
+        for (const std::string& dir : directories) {
+            if (!legacy(dir)) continue;
+            std::filesystem::remove_all(dir + "/.bundles", ec);
+            std::filesystem::remove(dir + "/.variants", ec);
+            if (std::filesystem::remove(dir, ec)) ++stats.directories;
+        }
+    }
+
+    return stats;
+}
@@ -1,81 +1,188 @@
+#include "../token_encryption.h"
 #include <openssl/evp.h>
+#include <openssl/core_names.h>
 #include <openssl/rand.h>
+#include <cstring>
 #include <vector>
 #include <sstream>
 
+static const char HEX_CHARS[] = "0123456789abcdef";
+
+/**
+* Per thread cipher state: the contexts keep the expanded key between calls and
+* the buffers only grow, so steady state encryption does not touch the allocator.
+**/
+struct CipherState {
+    EVP_CIPHER_CTX* encrypt_ctx = EVP_CIPHER_CTX_new();
+    EVP_CIPHER_CTX* decrypt_ctx = EVP_CIPHER_CTX_new();
+    std::string encrypt_key;
+    std::string decrypt_key;
+    std::vector<unsigned char> bytes;
+    std::string input;
+    std::string output;
+
+    ~CipherState() {
+        EVP_CIPHER_CTX_free(encrypt_ctx);
+        EVP_CIPHER_CTX_free(decrypt_ctx);
+    }
+};
+
+static CipherState& cipherState() {
+    thread_local CipherState state;
+    return state;
+}
+
+/**
+* Per thread HMAC state: the MAC implementation is fetched once and the keyed
+* context is only re-keyed when the key changes.
+**/
+struct MacState {
+    EVP_MAC* mac = EVP_MAC_fetch(nullptr, "HMAC", nullptr);
+    EVP_MAC_CTX* ctx = EVP_MAC_CTX_new(mac);
+    std::string key;
+    bool keyed = false;
+
+    ~MacState() {
+        EVP_MAC_CTX_free(ctx);
+        EVP_MAC_free(mac);
+    }
+};
+
+static MacState& macState() {
+    thread_local MacState state;
+    return state;
+}
+
+// AES-256 lee 32 bytes de clave; las claves cortas se rellenan con ceros
+static void keyBytes(const std::string& key, unsigned char (&out)[32]) {
+    std::memset(out, 0, sizeof(out));
+    std::memcpy(out, key.data(), std::min(key.size(), sizeof(out)));
+}
+
+static void appendHex(const unsigned char* data, size_t size, std::string& out) {
+    size_t offset = out.size();
+    out.resize(offset + size * 2);
+    for (size_t i = 0; i < size; ++i) {
+        out[offset + 2 * i] = HEX_CHARS[(data[i] >> 4) & 0x0F];
+        out[offset + 2 * i + 1] = HEX_CHARS[data[i] & 0x0F];
+    }
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return 0;
+}
+
 std::string toHex(const std::vector<unsigned char>& data) {
-    static const char hex_chars[] = "0123456789abcdef";
     std::string result;
-    result.reserve(data.size() * 2);
-    
-    for (unsigned char byte : data) {
-        result += hex_chars[(byte >> 4) & 0x0F];
-        result += hex_chars[byte & 0x0F];
-    }
-    
+    appendHex(data.data(), data.size(), result);
     return result;
 }
 
 // Versión segura de fromHex
-std::vector<unsigned char> fromHex(const std::string& hex) {
-    std::vector<unsigned char> data;
-    data.reserve(hex.length() / 2);
-    
-    for (size_t i = 0; i < hex.length(); i += 2) {
-        std::string byteString = hex.substr(i, 2);
-        char byte = static_cast<char>(strtol(byteString.c_str(), nullptr, 16));
-        data.push_back(byte);
-    }
-    
-    return data;
+static void fromHex(const std::string& hex, std::vector<unsigned char>& data) {
+    data.resize(hex.length() / 2);
+    for (size_t i = 0; i + 1 < hex.length(); i += 2)
+        data[i / 2] = static_cast<unsigned char>((hexValue(hex[i]) << 4) | hexValue(hex[i + 1]));
 }
 
 std::string encrypt_token(const std::string& token, const std::string& key, int rounds) {
-    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    CipherState& state = cipherState();
     unsigned char iv[EVP_MAX_IV_LENGTH] = {0};
-    std::string current_token = token;
 
+    if (state.encrypt_key != key) {
+        unsigned char key_bytes[32];
+        keyBytes(key, key_bytes);
+        EVP_EncryptInit_ex(state.encrypt_ctx, EVP_aes_256_cbc(), nullptr, key_bytes, iv);
+        state.encrypt_key = key;
+    }
+
+    state.input.assign(token);
     for (int i = 0; i < rounds; ++i) {
-        std::vector<unsigned char> ciphertext(token.size() + EVP_MAX_BLOCK_LENGTH);
-        int len;
-        
-        EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, 
-                          reinterpret_cast<const unsigned char*>(key.c_str()), iv);
-        EVP_EncryptUpdate(ctx, ciphertext.data(), &len, 
-                         reinterpret_cast<const unsigned char*>(current_token.c_str()), 
-                         current_token.size());
-        int final_len;
-        EVP_EncryptFinal_ex(ctx, ciphertext.data() + len, &final_len);
-        
-        current_token = toHex(std::vector<unsigned char>(
-            ciphertext.begin(), ciphertext.begin() + len + final_len));
+        // Reinicia solo el IV; la clave expandida se conserva en el contexto
+        EVP_EncryptInit_ex(state.encrypt_ctx, nullptr, nullptr, nullptr, iv);
+        state.bytes.resize(state.input.size() + EVP_MAX_BLOCK_LENGTH);
+
+        int len = 0, final_len = 0;
+        EVP_EncryptUpdate(state.encrypt_ctx, state.bytes.data(), &len,
+                          reinterpret_cast<const unsigned char*>(state.input.data()),
+                          static_cast<int>(state.input.size()));
+        EVP_EncryptFinal_ex(state.encrypt_ctx, state.bytes.data() + len, &final_len);
+
+        state.output.clear();
+        appendHex(state.bytes.data(), len + final_len, state.output);
+        state.input.swap(state.output);
     }
 
-    EVP_CIPHER_CTX_free(ctx);
-    return current_token;
+    return state.input;
 }
 
 std::string decrypt_token(const std::string& encrypted_token, const std::string& key, int rounds) {
-    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    CipherState& state = cipherState();
     unsigned char iv[EVP_MAX_IV_LENGTH] = {0};
-    std::string current_token = encrypted_token;
 
+    if (state.decrypt_key != key) {
+        unsigned char key_bytes[32];
+        keyBytes(key, key_bytes);
+        EVP_DecryptInit_ex(state.decrypt_ctx, EVP_aes_256_cbc(), nullptr, key_bytes, iv);
+        state.decrypt_key = key;
+    }
+
+    std::string current_token = encrypted_token;
+    std::vector<unsigned char> cipher_bytes;
     for (int i = 0; i < rounds; ++i) {
-        std::vector<unsigned char> cipher_bytes = fromHex(current_token);
-        std::vector<unsigned char> decrypted(cipher_bytes.size() + EVP_MAX_BLOCK_LENGTH);
-        int len;
-        
-        EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, 
-                          reinterpret_cast<const unsigned char*>(key.c_str()), iv);
-        EVP_DecryptUpdate(ctx, decrypted.data(), &len, 
-                         cipher_bytes.data(), cipher_bytes.size());
-        int final_len;
-        EVP_DecryptFinal_ex(ctx, decrypted.data() + len, &final_len);
-        
-        current_token = std::string(decrypted.begin(), 
-                                  decrypted.begin() + len + final_len);
+        EVP_DecryptInit_ex(state.decrypt_ctx, nullptr, nullptr, nullptr, iv);
+        fromHex(current_token, cipher_bytes);
+        state.bytes.resize(cipher_bytes.size() + EVP_MAX_BLOCK_LENGTH);
+
+        int len = 0, final_len = 0;
+        EVP_DecryptUpdate(state.decrypt_ctx, state.bytes.data(), &len,
+                          cipher_bytes.data(), static_cast<int>(cipher_bytes.size()));
+        EVP_DecryptFinal_ex(state.decrypt_ctx, state.bytes.data() + len, &final_len);
+
+        current_token.assign(reinterpret_cast<const char*>(state.bytes.data()), len + final_len);
     }
 
-    EVP_CIPHER_CTX_free(ctx);
     return current_token;
-}
\ No newline at end of file
+}
+
+std::string hmac_token(const std::string& token, const std::string& key) {
+    MacState& state = macState();
+    if (!state.keyed || state.key != key) {
+        char digest_name[] = "SHA256";
+        OSSL_PARAM params[] = {
+            OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest_name, 0),
+            OSSL_PARAM_construct_end()
+        };
+        EVP_MAC_init(state.ctx, reinterpret_cast<const unsigned char*>(key.data()), key.size(), params);
+        state.key = key;
+        state.keyed = true;
+    } else {
+        EVP_MAC_init(state.ctx, nullptr, 0, nullptr);
+    }
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    size_t digest_len = 0;
+    EVP_MAC_update(state.ctx, reinterpret_cast<const unsigned char*>(token.data()), token.size());
+    EVP_MAC_final(state.ctx, digest, &digest_len, sizeof(digest));
+
+    std::string result;
+    appendHex(digest, digest_len, result);
+    return result;
+}
+
+std::string digest_token(const std::string& token, const std::string& key, int rounds, TokenDigestMode mode) {
+    return mode == TokenDigestMode::Hmac ? hmac_token(token, key) : encrypt_token(token, key, rounds);
+}
+
+std::string sha256_hex(const char* data, size_t size) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+    EVP_Digest(data, size, digest, &digest_len, EVP_sha256(), nullptr);
+
+    std::string result;
+    appendHex(digest, digest_len, result);
+    return result;
+}
@@ -0,0 +1,404 @@
+#include "../token_store.h"
+#include "../env_loader.h"
+#include "../logger.h"
+#include "../metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+static int64_t nowSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// ────────────────────────
+//      Interface
+// ────────────────────────
+
+void TokenStore::consumeAsync(const std::string& session_key, const std::string& token_value,
+                              std::function<void(TokenStatus status)> done) {
+    done(consume(session_key, token_value));
+}
+
+// ────────────────────────
+//      Redis
+// ────────────────────────
+
+// KEYS[1] = csrf_token:<session>, KEYS[2] = token_uses:<session>, ARGV[1] = token
+static const std::string CONSUME_SCRIPT = R"(
+local stored = redis.call('GET', KEYS[1])
+if not stored then return -1 end
+if stored ~= ARGV[1] then return -2 end
+local uses = tonumber(redis.call('GET', KEYS[2]))
+if not uses then return -3 end
+if uses <= 0 then return -4 end
+return redis.call('DECR', KEYS[2])
+)";
+
+static TokenStatus statusOf(long long result) {
+    switch (result) {
+        case -1: return TokenStatus::NotFound;
+        case -2: return TokenStatus::Mismatch;
+        case -3: return TokenStatus::Expired;
+        case -4: return TokenStatus::Exhausted;
+        default: return TokenStatus::Valid;
+    }
+}
+
+static bool isNoScript(const sw::redis::Error& e) {
+    return std::string(e.what()).find("NOSCRIPT") != std::string::npos;
+}
+
+static sw::redis::ConnectionOptions connectionOptions(const RedisSettings& settings) {
+    sw::redis::ConnectionOptions options(settings.url);
+    options.connect_timeout = settings.connect_timeout;
+    options.socket_timeout = settings.socket_timeout;
+    options.keep_alive = settings.keep_alive;
+    return options;
+}
+
+static sw::redis::ConnectionPoolOptions poolOptions(const RedisSettings& settings) {
+    sw::redis::ConnectionPoolOptions options;
+    options.size = settings.pool_size;
+    // Los slots ya limitan la espera; esto solo cubre conexiones que se están reconectando
+    options.wait_timeout = settings.pool_wait_timeout;
+    options.connection_lifetime = settings.connection_lifetime;
+    return options;
+}
+
+RedisTokenStore::RedisTokenStore(const RedisSettings& settings)
+    : pool_wait_timeout(settings.pool_wait_timeout),
+      slots(static_cast<std::ptrdiff_t>(settings.pool_size)),
+      redis(connectionOptions(settings), poolOptions(settings)) {
+#ifdef PDFAST_ASYNC_REDIS
+    if (settings.async) {
+        async_redis = std::make_unique<sw::redis::AsyncRedis>(connectionOptions(settings), poolOptions(settings));
+        continuations = std::make_unique<ThreadPool>(std::max<size_t>(2, settings.pool_size / 2));
+    }
+#endif
+}
+
+template <class F>
+auto RedisTokenStore::call(F&& command) -> decltype(command()) {
+    {
+        PhaseTimer timer(Phase::RedisPoolWait);
+        if (!slots.try_acquire_for(pool_wait_timeout)) {
+            metrics().count(Counter::RedisPoolTimeouts);
+            throw sw::redis::Error("Timed out waiting for a Redis connection");
+        }
+    }
+    struct Release {
+        std::counting_semaphore<>& slots;
+        ~Release() { slots.release(); }
+    } release{slots};
+
+    try {
+        PhaseTimer timer(Phase::Redis);
+        return command();
+    } catch (const sw::redis::Error&) {
+        metrics().count(Counter::RedisErrors);
+        throw;
+    }
+}
+
+// Requiere un slot tomado con call()
+std::string RedisTokenStore::scriptSha(bool reload) {
+    std::lock_guard<std::mutex> lock(script_mutex);
+    if (script_sha.empty() || reload) script_sha = redis.script_load(CONSUME_SCRIPT);
+    return script_sha;
+}
+
+void RedisTokenStore::store(const std::string& session_key, const std::string& token_value, int max_uses, int ttl_seconds) {
+    call([&] {
+        auto transaction = redis.transaction(true, false);
+        transaction.setex("csrf_token:" + session_key, ttl_seconds, token_value)
+                   .setex("token_uses:" + session_key, ttl_seconds, std::to_string(max_uses))
+                   .exec();
+    });
+}
+
+TokenStatus RedisTokenStore::consume(const std::string& session_key, const std::string& token_value) {
+    std::string csrf_key = "csrf_token:" + session_key;
+    std::string uses_key = "token_uses:" + session_key;
+
+    try {
+        return statusOf(call([&] {
+            try {
+                return redis.evalsha<long long>(scriptSha(false), {csrf_key, uses_key}, {token_value});
+            } catch (const sw::redis::ReplyError& e) {
+                // Redis reiniciado o SCRIPT FLUSH: se vuelve a cargar el script una vez
+                if (!isNoScript(e)) throw;
+                return redis.evalsha<long long>(scriptSha(true), {csrf_key, uses_key}, {token_value});
+            }
+        }));
+    } catch (const sw::redis::Error&) {
+        return TokenStatus::Unavailable;
+    }
+}
+
+void RedisTokenStore::consumeAsync(const std::string& session_key, const std::string& token_value,
+                                   std::function<void(TokenStatus status)> done) {
+#ifdef PDFAST_ASYNC_REDIS
+    if (async_redis) {
+        bool loaded;
+        {
+            std::lock_guard<std::mutex> lock(script_mutex);
+            loaded = !script_sha.empty();
+        }
+        // El SHA se carga una sola vez con el cliente síncrono, desde el hilo del handler
+        try {
+            if (!loaded) call([&] { return scriptSha(false); });
+        } catch (const sw::redis::Error&) {
+            done(TokenStatus::Unavailable);
+            return;
+        }
+        consumeAsync(session_key, token_value, false, std::move(done));
+        return;
+    }
+#endif
+    TokenStore::consumeAsync(session_key, token_value, std::move(done));
+}
+
+#ifdef PDFAST_ASYNC_REDIS
+void RedisTokenStore::consumeAsync(const std::string& session_key, const std::string& token_value, bool use_script,
+                                   std::function<void(TokenStatus status)> done) {
+    auto started = std::chrono::steady_clock::now();
+    auto finished = [this, session_key, token_value, use_script, done, started](sw::redis::Future<long long>&& reply) {
+        metrics().recordPhase(Phase::Redis, std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - started).count());
+
+        // El callback corre en el event loop de Redis: el resto de la petición sigue en otro hilo
+        TokenStatus status;
+        try {
+            status = statusOf(reply.get());
+        } catch (const sw::redis::ReplyError& e) {
+            // Redis perdió el script: se manda completo con EVAL, que lo deja otra vez bajo el mismo SHA
+            if (!use_script && isNoScript(e)) {
+                consumeAsync(session_key, token_value, true, done);
+                return;
+            }
+            metrics().count(Counter::RedisErrors);
+            status = TokenStatus::Unavailable;
+        } catch (const sw::redis::Error&) {
+            metrics().count(Counter::RedisErrors);
+            status = TokenStatus::Unavailable;
+        }
+        continuations->post([done, status] { done(status); });
+    };
+
+    std::string csrf_key = "csrf_token:" + session_key;
+    std::string uses_key = "token_uses:" + session_key;
+    if (use_script) {
+        async_redis->command<long long>("EVAL", CONSUME_SCRIPT, "2", csrf_key, uses_key, token_value, std::move(finished));
+        return;
+    }
+
+    std::string sha;
+    {
+        std::lock_guard<std::mutex> lock(script_mutex);
+        sha = script_sha;
+    }
+    async_redis->command<long long>("EVALSHA", sha, "2", csrf_key, uses_key, token_value, std::move(finished));
+}
+#endif
+
+// ────────────────────────
+//      In-process
+// ────────────────────────
+
+MemoryTokenStore::MemoryTokenStore(const std::string& snapshot_path, int snapshot_interval)
+    : current_tick(nowSeconds()), snapshot_path(snapshot_path), snapshot_interval(snapshot_interval) {
+    if (!snapshot_path.empty()) loadSnapshot();
+    ticker = std::thread(&MemoryTokenStore::run, this);
+}
+
+MemoryTokenStore::~MemoryTokenStore() {
+    {
+        std::lock_guard<std::mutex> lock(run_mutex);
+        stopping = true;
+    }
+    run_cv.notify_all();
+    if (ticker.joinable()) ticker.join();
+    if (!snapshot_path.empty()) saveSnapshot();
+}
+
+MemoryTokenStore::Shard& MemoryTokenStore::shardFor(const std::string& session_key) {
+    return shards[std::hash<std::string>{}(session_key) % SHARD_COUNT];
+}
+
+void MemoryTokenStore::insert(const std::string& session_key, Token token) {
+    int64_t expires_at = token.expires_at;
+    {
+        Shard& shard = shardFor(session_key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.tokens[session_key] = std::move(token);
+    }
+    std::lock_guard<std::mutex> lock(wheel_mutex);
+    schedule(session_key, expires_at);
+}
+
+void MemoryTokenStore::store(const std::string& session_key, const std::string& token_value, int max_uses, int ttl_seconds) {
+    insert(session_key, Token{token_value, max_uses, nowSeconds() + ttl_seconds});
+}
+
+TokenStatus MemoryTokenStore::consume(const std::string& session_key, const std::string& token_value) {
+    Shard& shard = shardFor(session_key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.tokens.find(session_key);
+    if (it == shard.tokens.end()) return TokenStatus::NotFound;
+    if (it->second.expires_at <= nowSeconds()) {
+        shard.tokens.erase(it);
+        return TokenStatus::NotFound;
+    }
+    if (it->second.value != token_value) return TokenStatus::Mismatch;
+    if (it->second.uses <= 0) return TokenStatus::Exhausted;
+
+    it->second.uses--;
+    return TokenStatus::Valid;
+}
+
+size_t MemoryTokenStore::size() const {
+    size_t total = 0;
+    for (const Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.tokens.size();
+    }
+    return total;
+}
+
+// Requiere wheel_mutex
+void MemoryTokenStore::schedule(const std::string& session_key, int64_t expires_at) {
+    // Lo vencido sale en el próximo tick; lo que excede el último nivel se reprograma al bajar
+    int64_t horizon = int64_t{1} << (WHEEL_BITS * WHEEL_LEVELS);
+    int64_t slot_time = std::max(expires_at, current_tick + 1);
+    slot_time = std::min(slot_time, current_tick + horizon - 1);
+    int64_t delta = slot_time - current_tick;
+
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (int64_t{1} << (WHEEL_BITS * (level + 1))))
+        level++;
+
+    size_t slot = (slot_time >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+    wheel[level][slot].push_back({session_key, expires_at});
+}
+
+void MemoryTokenStore::expire(const Timer& timer) {
+    Shard& shard = shardFor(timer.session_key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Un store posterior con la misma sesión tiene otro vencimiento y sigue vivo
+    auto it = shard.tokens.find(timer.session_key);
+    if (it != shard.tokens.end() && it->second.expires_at == timer.expires_at)
+        shard.tokens.erase(it);
+}
+
+void MemoryTokenStore::advance(int64_t now) {
+    while (true) {
+        std::vector<Timer> due;
+        {
+            std::lock_guard<std::mutex> lock(wheel_mutex);
+            if (current_tick >= now) return;
+            int64_t tick = ++current_tick;
+
+            // Al completar una vuelta del nivel inferior se reparte el slot del nivel superior
+            for (int level = WHEEL_LEVELS - 1; level > 0; --level) {
+                int64_t span = int64_t{1} << (WHEEL_BITS * level);
+                if (tick % span != 0) continue;
+                size_t slot = (tick >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+                std::vector<Timer> cascade;
+                cascade.swap(wheel[level][slot]);
+                for (const Timer& timer : cascade) schedule(timer.session_key, timer.expires_at);
+            }
+
+            std::vector<Timer>& slot = wheel[0][tick & (WHEEL_SLOTS - 1)];
+            for (Timer& timer : slot) {
+                if (timer.expires_at <= tick) due.push_back(std::move(timer));
+                else schedule(timer.session_key, timer.expires_at);
+            }
+            slot.clear();
+        }
+        for (const Timer& timer : due) expire(timer);
+    }
+}
+
+void MemoryTokenStore::run() {
+    int64_t last_snapshot = nowSeconds();
+    std::unique_lock<std::mutex> lock(run_mutex);
+
+    while (!stopping) {
+        run_cv.wait_for(lock, std::chrono::seconds(1));
+        if (stopping) break;
+
+        lock.unlock();
+        int64_t now = nowSeconds();
+        advance(now);
+        if (!snapshot_path.empty() && now - last_snapshot >= snapshot_interval) {
+            saveSnapshot();
+            last_snapshot = now;
+        }
+        lock.lock();
+    }
+}
+
+void MemoryTokenStore::saveSnapshot() const {
+    std::string temp_path = snapshot_path + ".tmp";
+    std::ofstream file(temp_path, std::ios::trunc);
+    if (!file) {
+        LOG_ERROR("Cannot write token snapshot", {"path", temp_path});
+        return;
+    }
+
+    int64_t now = nowSeconds();
+    for (const Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (const auto& [session_key, token] : shard.tokens) {
+            if (token.expires_at <= now) continue;
+            file << session_key << '\t' << token.value << '\t' << token.uses << '\t' << token.expires_at << '\n';
+        }
+    }
+
+    file.close();
+    if (!file || std::rename(temp_path.c_str(), snapshot_path.c_str()) != 0)
+        LOG_ERROR("Cannot write token snapshot", {"path", snapshot_path});
+}
+
+void MemoryTokenStore::loadSnapshot() {
+    std::ifstream file(snapshot_path);
+    if (!file) return;
+
+    int64_t now = nowSeconds();
+    for (std::string line; std::getline(file, line);) {
+        std::istringstream fields(line);
+        std::string session_key, value;
+        Token token;
+        if (!std::getline(fields, session_key, '\t') || !std::getline(fields, value, '\t') ||
+            !(fields >> token.uses >> token.expires_at))
+            continue;
+        if (token.expires_at <= now) continue;
+
+        token.value = value;
+        insert(session_key, std::move(token));
+    }
+}
+
+TokenStore& token_store() {
+    static std::unique_ptr<TokenStore> store = []() -> std::unique_ptr<TokenStore> {
+        if (env_string("TOKEN_STORE", "redis") == "memory")
+            return std::make_unique<MemoryTokenStore>(
+                env_string("TOKEN_STORE_SNAPSHOT", ""),
+                static_cast<int>(env_integer("TOKEN_STORE_SNAPSHOT_INTERVAL", 60)));
+        return std::make_unique<RedisTokenStore>(RedisSettings{
+            env_string("REDIS_URL", "tcp://redis:6379"),
+            static_cast<size_t>(std::max(1LL, env_integer("REDIS_POOL_SIZE", 8))),
+            std::chrono::milliseconds(env_integer("REDIS_CONNECT_TIMEOUT_MS", 200)),
+            std::chrono::milliseconds(env_integer("REDIS_SOCKET_TIMEOUT_MS", 500)),
+            std::chrono::milliseconds(env_integer("REDIS_POOL_WAIT_MS", 100)),
+            std::chrono::seconds(env_integer("REDIS_CONNECTION_LIFETIME_S", 0)),
+            env_integer("REDIS_KEEPALIVE", 1) != 0,
+            env_integer("REDIS_ASYNC", 0) != 0});
+    }();
+    return *store;
+}
@@ -2,7 +2,7 @@
 #define __CSRF_TOKEN_GENERATOR_H__
 
 #include <string>
-#include <sw/redis++/redis++.h>
+#include "token_store.h"
 #include "crow.h"
 
 /**
@@ -13,16 +13,31 @@
 std::string generate_csrf_token();
 
 /**
- * A function that validates a CSRF token with the one stored in the Redis database.
- * @param csrf_token The CSRF token to validate -> string
- * @param session_id The session ID to validate the CSRF token -> string
- * @return True if the token is valid, false otherwise -> bool
+* A function that stores a CSRF token and its use counter in the configured token store.
+* @param session_key The digested session ID -> string
+* @param token_value The digested CSRF token -> string
+* @param max_uses The number of writes allowed with the token -> int
+* @param ttl_seconds Lifetime of the token -> int
 **/
-bool validate_csrf_token(const std::string& csrf_token, const std::string& session_id);
+void store_csrf_token(const std::string& session_key, const std::string& token_value, int max_uses, int ttl_seconds);
 
-/*
-* The Redis database object
-*/
-extern sw::redis::Redis redis;
+/**
+* A function that compares the token, checks the remaining uses and decrements them atomically
+* in the configured token store (a single EVALSHA round trip with Redis).
+* @param session_key The digested session ID -> string
+* @param token_value The digested CSRF token sent by the client -> string
+* @return The status of the token -> TokenStatus
+**/
+TokenStatus consume_csrf_token(const std::string& session_key, const std::string& token_value);
+
+/**
+* Same as consume_csrf_token, without holding the calling thread while the token store answers
+* (an AsyncRedis round trip when REDIS_ASYNC is enabled).
+* @param session_key The digested session ID -> string
+* @param token_value The digested CSRF token sent by the client -> string
+* @param done Receives the status of the token, possibly on another thread -> function
+**/
+void consume_csrf_token(const std::string& session_key, const std::string& token_value,
+                        std::function<void(TokenStatus status)> done);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,135 @@
+#ifndef __DISK_IO_H__
+#define __DISK_IO_H__
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include "thread_pool.h"
+
+#if __has_include(<liburing.h>)
+#define PDFAST_IO_URING 1
+#endif
+
+/**
+* @brief Asynchronous disk I/O, so handlers stop blocking Crow's worker threads.
+* Any thread queues operations; a single completion thread submits everything queued
+* since its last wake-up as one io_uring batch and runs the callbacks as completions
+* arrive. When io_uring is not compiled in, cannot be set up (kernel, seccomp) or lacks
+* one of the opcodes, every operation runs as a blocking syscall on a dedicated pool.
+* Callbacks receive the syscall result: >= 0 on success, -errno on failure. They run on
+* the completion thread (or a pool worker) and must not block.
+**/
+class DiskIO {
+public:
+    using Callback = std::function<void(int result)>;
+
+    /**
+    * @param queue_depth Entries of the io_uring submission queue
+    * @param threads Workers of the blocking pool, used for every operation without io_uring
+    * @param use_uring Whether to try io_uring at all
+    **/
+    DiskIO(unsigned queue_depth, size_t threads, bool use_uring);
+    ~DiskIO();
+
+    DiskIO(const DiskIO&) = delete;
+    DiskIO& operator=(const DiskIO&) = delete;
+
+    void open(const std::string& path, int flags, mode_t mode, Callback done);
+    void stat(const std::string& path, struct stat* out, Callback done);
+    void read(int fd, char* buffer, size_t length, uint64_t offset, Callback done);
+    void write(int fd, const char* buffer, size_t length, uint64_t offset, Callback done);
+    void fsync(int fd, Callback done);
+    void rename(const std::string& from, const std::string& to, Callback done);
+    void close(int fd, Callback done);
+
+    /**
+    * @brief Reads until length bytes are in the buffer or the file ends
+    * @param done Receives the number of bytes read, or -errno
+    **/
+    void readFully(int fd, char* buffer, size_t length, uint64_t offset, Callback done);
+
+    /**
+    * @brief Opens, reads and closes a file
+    * @param path The file to read
+    * @param body Receives the contents; read up to its current size, then shrunk to what was read
+    * @param done Receives the number of bytes read, or -errno
+    * @param expected If set, the file opened must still be the one this stat describes (same inode,
+    * size and mtime); a file replaced since then is not read and done receives -ESTALE
+    **/
+    void readFile(const std::string& path, std::shared_ptr<std::string> body, Callback done,
+                  std::shared_ptr<const struct stat> expected = nullptr);
+
+    /**
+    * @brief Replaces a file atomically, like AtomicFileWriter: hidden temporary file written
+    * in parallel chunks, fsync, rename over the target and fsync of the directory.
+    * Missing parent directories are created.
+    * @param data The bytes to write; must stay valid until done runs
+    * @param done Receives 0, or -errno
+    **/
+    void writeFile(const std::string& path, const char* data, size_t size, Callback done);
+
+    /**
+    * @brief Runs a blocking task on the pool, for calls without an io_uring opcode
+    **/
+    void blocking(std::function<void()> task);
+
+    /**
+    * @brief Waits until every queued operation has finished and its callback returned
+    **/
+    void drain();
+
+    /**
+    * @return "io_uring" or "threads"
+    **/
+    const char* backend() const;
+
+private:
+    struct Op;
+
+    struct Transfer;
+    struct WriteJob;
+
+    void submit(std::unique_ptr<Op> op);
+    void finish(Op* op, int result);
+    static int runBlocking(Op& op);
+
+    void readStep(std::shared_ptr<Transfer> transfer);
+    void writeStep(std::shared_ptr<Transfer> transfer);
+    void openTemp(std::shared_ptr<WriteJob> job);
+    void commitTemp(std::shared_ptr<WriteJob> job);
+    void abortTemp(std::shared_ptr<WriteJob> job, int error);
+
+#ifdef PDFAST_IO_URING
+    bool setupRing(unsigned queue_depth);
+    void runRing();
+    void armWake();
+
+    struct Ring;
+    std::unique_ptr<Ring> ring;
+    int wake_fd = -1;
+    uint64_t wake_value = 0;
+    std::thread completer;
+#endif
+
+    ThreadPool pool;
+
+    std::mutex mutex;
+    std::condition_variable idle_cv;
+    std::deque<std::unique_ptr<Op>> queued;
+    size_t outstanding = 0;
+    bool stopping = false;
+};
+
+/**
+* @brief The process wide disk I/O engine, configured with DISK_IO_BACKEND,
+* DISK_IO_QUEUE_DEPTH and DISK_IO_THREADS
+**/
+DiskIO& disk_io();
+
+#endif
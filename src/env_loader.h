@@ -13,4 +13,27 @@
 **/
 std::unordered_map<std::string, std::string> load_env_file(const std::string& fileName);
 
+/**
+* A function that reads an integer variable from ENV.
+* If the variable is missing or is not a number, the fallback is returned.
+* @param name: The name of the variable -> const string&
+* @param fallback: The value used when the variable is not usable -> long long
+* @return The value of the variable -> long long
+**/
+long long env_integer(const std::string& name, long long fallback);
+
+/**
+* A function that reads a string variable from ENV.
+* @param name: The name of the variable -> const string&
+* @param fallback: The value used when the variable is missing -> const string&
+* @return The value of the variable -> string
+**/
+std::string env_string(const std::string& name, const std::string& fallback);
+
+/**
+* Environment variables read from .env at startup. Never modified: settings that
+* can change at runtime are read through config()
+**/
+extern const std::unordered_map<std::string, std::string> ENV;
+
 #endif
\ No newline at end of file
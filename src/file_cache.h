@@ -0,0 +1,143 @@
+#ifndef __FILE_CACHE_H__
+#define __FILE_CACHE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+* @brief A file held in memory together with the headers needed to serve it
+**/
+struct CachedFile {
+    std::string body;
+    std::string content_type;
+    std::string etag;
+    time_t last_modified;
+};
+
+/**
+* @brief Snapshot of the cache counters, used to size the byte budget
+**/
+struct FileCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t insertions;
+    uint64_t evictions;
+    uint64_t invalidations;
+    uint64_t stale_rejections;
+    uint64_t bytes;
+    uint64_t entries;
+    uint64_t capacity_bytes;
+};
+
+/**
+* @brief Sharded LRU cache of file contents bounded by a total byte budget.
+* Every shard has its own lock and its own LRU list, so readers of different
+* files rarely contend. Each shard also keeps a generation counter that is
+* bumped on invalidation: a loader takes the generation before reading the
+* disk and the insert is dropped if a write happened in between, so a
+* re-uploaded file is never cached with its old contents.
+**/
+class FileCache {
+public:
+    /**
+    * @param capacity_bytes Total bytes the cache may hold across all shards
+    * @param max_entry_bytes Files bigger than this are never cached
+    * @param shard_count Number of independent shards
+    **/
+    FileCache(size_t capacity_bytes, size_t max_entry_bytes, size_t shard_count = 16);
+
+    /**
+    * @brief Looks up a file and marks it as recently used
+    * @param path The path of the file
+    * @return The cached file or nullptr on a miss
+    **/
+    std::shared_ptr<const CachedFile> get(const std::string& path);
+
+    /**
+    * @brief Returns the generation a loader must pass to put()
+    * @param path The path that is about to be read from disk
+    * @return The current generation of the shard owning the path
+    **/
+    uint64_t generation(const std::string& path);
+
+    /**
+    * @brief Inserts a file unless it was invalidated since generation() was taken
+    * @param path The path of the file
+    * @param file The contents and headers of the file
+    * @param generation The value returned by generation() before the disk read
+    * @param speculative For read-ahead: the file is only inserted if it is not cached yet and fits
+    * without evicting anything, and it goes to the cold end of the LRU until it is read
+    * @return True if the file was inserted
+    **/
+    bool put(const std::string& path, std::shared_ptr<const CachedFile> file, uint64_t generation,
+             bool speculative = false);
+
+    /**
+    * @brief Whether a file is cached, without counting a hit or a miss nor touching the LRU
+    * @param path The path of the file
+    **/
+    bool contains(const std::string& path);
+
+    /**
+    * @brief Drops a file from the cache and fences out in-flight loads of it
+    * @param path The path of the file
+    **/
+    void invalidate(const std::string& path);
+
+    /**
+    * @brief Whether a file of the given size is allowed in the cache
+    * @param size The size of the file in bytes
+    **/
+    bool admits(uintmax_t size) const;
+
+    /**
+    * @return A snapshot of the hit/miss/eviction counters
+    **/
+    FileCacheStats stats() const;
+
+private:
+    struct Entry {
+        std::string path;
+        std::shared_ptr<const CachedFile> file;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+        uint64_t generation = 0;
+    };
+
+    Shard& shardFor(const std::string& path);
+    void evict(Shard& shard);
+
+    size_t capacity_bytes;
+    size_t shard_capacity;
+    size_t max_entry_bytes;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> insertions{0};
+    std::atomic<uint64_t> evictions{0};
+    std::atomic<uint64_t> invalidations{0};
+    std::atomic<uint64_t> stale_rejections{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> entries{0};
+};
+
+/**
+* @brief The process wide cache, sized from FILE_CACHE_BYTES and FILE_CACHE_MAX_ENTRY_BYTES
+* @return The hot-file cache shared by every route
+**/
+FileCache& hot_file_cache();
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef __HTTP_CONDITIONAL_H__
+#define __HTTP_CONDITIONAL_H__
+
+#include <ctime>
+#include <string>
+
+/**
+* @brief Formats a timestamp as an IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT")
+* @param timestamp Seconds since the epoch
+* @return The HTTP date
+**/
+std::string http_date(time_t timestamp);
+
+/**
+* @brief Parses an IMF-fixdate as sent in If-Modified-Since or If-Range
+* @param value The header value
+* @param timestamp Output: seconds since the epoch
+* @return True if the value is a valid date
+**/
+bool parse_http_date(const std::string& value, time_t& timestamp);
+
+/**
+* @brief Checks an If-None-Match list ("*", or comma separated, possibly weak, ETags)
+* Uses the weak comparison required for If-None-Match.
+* @param header The value of If-None-Match
+* @param etag The current strong ETag of the resource
+* @return True if any listed ETag matches
+**/
+bool etag_list_matches(const std::string& header, const std::string& etag);
+
+/**
+* @brief Evaluates If-None-Match and If-Modified-Since in the order mandated by RFC 9110
+* If-Modified-Since is only looked at when If-None-Match is absent.
+* @param if_none_match The value of If-None-Match (may be empty)
+* @param if_modified_since The value of If-Modified-Since (may be empty)
+* @param etag The current ETag of the resource
+* @param last_modified The modification time of the resource
+* @return True if the client copy is current and 304 should be answered
+**/
+bool is_not_modified(const std::string& if_none_match, const std::string& if_modified_since,
+                     const std::string& etag, time_t last_modified);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef __HTTP_RANGE_H__
+#define __HTTP_RANGE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+* @brief An inclusive byte range of a file, already resolved against its size
+**/
+struct ByteRange {
+    uintmax_t first;
+    uintmax_t last;
+    bool open_ended = false;      // "first-": the client asked for everything up to the end
+
+    uintmax_t length() const { return last - first + 1; }
+};
+
+/**
+* @brief Outcome of parsing a Range header
+* Ignored: the header is absent, malformed or not worth honouring, serve the whole file
+* Satisfiable: serve the ranges with 206
+* Unsatisfiable: none of the ranges overlaps the file, answer 416
+**/
+enum class RangeResult { Ignored, Satisfiable, Unsatisfiable };
+
+/**
+* @brief Parses a "bytes=" Range header (single and multiple ranges, suffix and open ended)
+* Overlapping or adjacent ranges are coalesced and returned in ascending order.
+* @param header The value of the Range header
+* @param file_size The size of the file the ranges apply to
+* @param ranges Output: the resolved ranges when the result is Satisfiable
+* @param max_ranges Headers with more ranges than this are ignored
+* @return Whether the ranges should be served, ignored or rejected
+**/
+RangeResult parse_range_header(const std::string& header, uintmax_t file_size,
+                               std::vector<ByteRange>& ranges, size_t max_ranges = 16);
+
+/**
+* @brief Formats the value of a Content-Range header
+* @param range The range being sent
+* @param file_size The complete size of the file
+* @return "bytes first-last/size"
+**/
+std::string content_range(const ByteRange& range, uintmax_t file_size);
+
+#endif
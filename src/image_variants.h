@@ -0,0 +1,104 @@
+#ifndef __IMAGE_VARIANTS_H__
+#define __IMAGE_VARIANTS_H__
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "thread_pool.h"
+
+/**
+* @brief The file chosen to answer a request for a downscaled image
+* path: the variant to serve, empty to serve the original
+* pending: the variant is being generated, so the original is only a stand-in
+**/
+struct VariantChoice {
+    std::string path;
+    bool pending;
+};
+
+/**
+* @brief Downscaled copies of uploaded JPEG and PNG images.
+* Every upload queues the generation of one variant per configured size (longest side in
+* pixels) on a background pool; images are decoded with libjpeg / libpng, which ship with
+* the OS. Variants live in a hidden ".variants" directory next to the original, so the path
+* index and the watcher ignore them. A re-upload removes the variants of the file and fences
+* out jobs still working on the old contents through a per-path generation counter.
+**/
+class ImageVariants {
+public:
+    /**
+    * @param sizes Longest side of every variant in pixels
+    * @param threads Number of background workers
+    * @param quality JPEG quality of the variants (1-100)
+    **/
+    ImageVariants(std::vector<int> sizes, size_t threads, int quality);
+
+    /**
+    * @brief Whether variants can be generated for a file (JPEG or PNG)
+    * @param path The path of the original
+    **/
+    bool supports(const std::string& path) const;
+
+    /**
+    * @brief Removes the variants of a file and queues their generation from its current contents
+    * @param path The path of the original, already in place
+    **/
+    void schedule(const std::string& path);
+
+    /**
+    * @brief Picks the smallest variant at least as big as the requested size
+    * Originals that were never processed by this process (uploaded before a restart)
+    * are queued on first request.
+    * @param path The path of the original
+    * @param requested The size asked by the client in pixels
+    * @return The variant to serve, or an empty path to serve the original
+    **/
+    VariantChoice select(const std::string& path, int requested);
+
+    /**
+    * @brief The path where the variant of an original is stored
+    * @param path The path of the original
+    * @param size The longest side of the variant
+    **/
+    static std::string variantPath(const std::string& path, int size);
+
+private:
+    static constexpr size_t STRIPE_COUNT = 16;
+    static constexpr size_t STRIPE_STATES = 4096;
+
+    // Only paths being generated or that could not get every variant (too small, undecodable)
+    // keep a state; a finished generation that wrote every variant drops it
+    struct State {
+        uint64_t generation = 0;
+        bool running = false;
+    };
+
+    struct Stripe {
+        std::mutex mutex;
+        std::unordered_map<std::string, State> states;
+        uint64_t next_generation = 0;   // Never reused, so a dropped state cannot revive an old job
+    };
+
+    Stripe& stripeFor(const std::string& path);
+    void queue(Stripe& stripe, const std::string& path);
+    void generate(const std::string& path, uint64_t generation);
+    void removeVariants(const std::string& path);
+
+    std::vector<int> sizes;
+    int quality;
+    std::array<Stripe, STRIPE_COUNT> stripes;
+    ThreadPool pool;
+};
+
+/**
+* @brief The process wide generator, configured with IMAGE_VARIANT_SIZES, IMAGE_VARIANT_WORKERS
+* and IMAGE_VARIANT_QUALITY
+* @return The generator shared by every route
+**/
+ImageVariants& image_variants();
+
+#endif
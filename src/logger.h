@@ -0,0 +1,130 @@
+#ifndef __LOGGER_H__
+#define __LOGGER_H__
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+enum class LogLevel { Debug, Info, Warn, Error };
+
+/**
+* @brief A key=value pair attached to a log line
+**/
+struct LogField {
+    const char* key;
+    std::string_view value;
+};
+
+/**
+* @brief Per call site state used to rate-limit repeated messages.
+* Declared as a static by the LOG_* macros, one per call site.
+**/
+struct LogSite {
+    std::atomic<int64_t> window{0};
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> suppressed{0};
+};
+
+/**
+* @brief Asynchronous logger writing one logfmt line per message.
+* Each thread formats its lines into its own fixed size ring buffer (single producer,
+* single consumer, no locks); a background thread drains every ring into the output
+* a few times per second with one write and one flush. When a ring is full the line is
+* dropped and counted instead of blocking the request. Every call site may log at most
+* LOG_RATE_LIMIT lines per second; the rest are counted and reported on the next line.
+**/
+class Logger {
+public:
+    Logger();
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    /**
+    * @brief Whether lines of a level pass the LOG_LEVEL threshold
+    **/
+    bool enabled(LogLevel level) const { return level >= min_level; }
+
+    /**
+    * @brief Formats a line into the ring of the calling thread
+    * @param level The level of the line
+    * @param site The rate-limit state of the call site
+    * @param message The message
+    * @param fields Extra key=value pairs
+    **/
+    void write(LogLevel level, LogSite& site, std::string_view message, std::initializer_list<LogField> fields);
+
+    /**
+    * @brief Writes every pending line now
+    **/
+    void flush();
+
+private:
+    static constexpr size_t RING_SLOTS = 256;
+    static constexpr size_t SLOT_TEXT = 496;
+
+    struct Slot {
+        int64_t time_ns;
+        LogLevel level;
+        uint16_t length;
+        char text[SLOT_TEXT];
+    };
+
+    struct Ring {
+        std::array<Slot, RING_SLOTS> slots;
+        alignas(64) std::atomic<uint64_t> head{0};
+        alignas(64) std::atomic<uint64_t> tail{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> orphaned{false};
+    };
+
+    Ring& local();
+    void drain();
+    void run();
+
+    LogLevel min_level;
+    uint32_t rate_limit;
+    FILE* output;
+
+    std::mutex rings_mutex;
+    std::vector<std::shared_ptr<Ring>> rings;
+
+    std::mutex drain_mutex;
+    std::mutex run_mutex;
+    std::condition_variable run_cv;
+    bool stopping = false;
+    std::thread drainer;
+};
+
+/**
+* @brief The process wide logger, configured with LOG_LEVEL, LOG_FILE and LOG_RATE_LIMIT
+**/
+Logger& logger();
+
+#define LOG_AT(level, message, ...)                                              \
+    do {                                                                         \
+        static LogSite pdfast_log_site;                                          \
+        if (logger().enabled(level))                                             \
+            logger().write(level, pdfast_log_site, message, {__VA_ARGS__});      \
+    } while (0)
+
+// Debug lines only exist in builds compiled with -DPDFAST_DEBUG_LOG
+#ifdef PDFAST_DEBUG_LOG
+#define LOG_DEBUG(message, ...) LOG_AT(LogLevel::Debug, message, __VA_ARGS__)
+#else
+#define LOG_DEBUG(message, ...) do {} while (0)
+#endif
+#define LOG_INFO(message, ...) LOG_AT(LogLevel::Info, message, __VA_ARGS__)
+#define LOG_WARN(message, ...) LOG_AT(LogLevel::Warn, message, __VA_ARGS__)
+#define LOG_ERROR(message, ...) LOG_AT(LogLevel::Error, message, __VA_ARGS__)
+
+#endif
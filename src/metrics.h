@@ -0,0 +1,135 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "crow.h"
+
+/**
+* Internal steps timed separately from the whole request.
+**/
+enum class Phase { EncryptToken, Redis, RedisPoolWait, DiskOpen, DiskRead, DiskWrite };
+
+/**
+* Events counted without a duration.
+**/
+enum class Counter {
+    RedisErrors, RedisPoolTimeouts, AdmissionOverloaded, AdmissionRateLimited,
+    PrefetchPages, PrefetchHits, PrefetchWasted, PrefetchBudgetExhausted
+};
+
+/**
+* @brief Request and phase metrics exported in the Prometheus text format.
+* Every counter lives in a fixed size array of plain atomics inside a shard; each thread
+* writes to its own shard with relaxed increments, so recording never takes a lock or
+* bounces a cache line between Crow's workers. The shards are only summed by render().
+**/
+class Metrics {
+public:
+    /**
+    * @param shard_count Number of shards, threads are spread over them round-robin
+    **/
+    explicit Metrics(size_t shard_count = 32);
+
+    /**
+    * @brief Records a finished request
+    * @param method The HTTP method
+    * @param url The path of the request, used to find its route
+    * @param status The status code sent
+    * @param nanoseconds Time spent handling the request
+    * @param bytes_in Size of the request body
+    * @param bytes_out Size of the response body
+    **/
+    void recordRequest(crow::HTTPMethod method, const std::string& url, int status,
+                       uint64_t nanoseconds, uint64_t bytes_in, uint64_t bytes_out);
+
+    /**
+    * @brief Records the duration of one internal phase
+    * @param phase The phase
+    * @param nanoseconds Time spent in it
+    **/
+    void recordPhase(Phase phase, uint64_t nanoseconds);
+
+    /**
+    * @brief Adds to an event counter
+    * @param counter The counter
+    * @param amount How much to add
+    **/
+    void count(Counter counter, uint64_t amount = 1);
+
+    /**
+    * @return Every metric in the Prometheus text exposition format
+    **/
+    std::string render() const;
+
+private:
+    static constexpr size_t ROUTE_COUNT = 19;
+    static constexpr size_t STATUS_COUNT = 16;
+    static constexpr size_t BUCKET_COUNT = 18;
+    static constexpr size_t PHASE_COUNT = 6;
+    static constexpr size_t COUNTER_COUNT = 8;
+
+    struct Histogram {
+        std::array<std::atomic<uint64_t>, BUCKET_COUNT + 1> buckets{};
+        std::atomic<uint64_t> sum_ns{0};
+
+        void observe(uint64_t nanoseconds);
+    };
+
+    struct alignas(64) Shard {
+        std::array<std::array<std::atomic<uint64_t>, STATUS_COUNT>, ROUTE_COUNT> requests{};
+        std::array<Histogram, ROUTE_COUNT> latency;
+        std::array<std::atomic<uint64_t>, ROUTE_COUNT> bytes_in{};
+        std::array<std::atomic<uint64_t>, ROUTE_COUNT> bytes_out{};
+        std::array<Histogram, PHASE_COUNT> phases;
+        std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+    };
+
+    Shard& local();
+    static size_t routeFor(crow::HTTPMethod method, const std::string& url);
+    static size_t statusIndex(int status);
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<size_t> next_shard{0};
+};
+
+/**
+* @brief The process wide metrics
+* @return The metrics shared by every route, sharded by METRICS_SHARDS
+**/
+Metrics& metrics();
+
+/**
+* @brief Times a scope and records it as a phase when destroyed
+**/
+class PhaseTimer {
+public:
+    explicit PhaseTimer(Phase phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+    ~PhaseTimer();
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+/**
+* @brief Crow middleware that times every request and records it in metrics()
+**/
+struct MetricsMiddleware {
+    struct context {
+        std::chrono::steady_clock::time_point start;
+    };
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
+
+#endif
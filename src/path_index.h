@@ -0,0 +1,158 @@
+#ifndef __PATH_INDEX_H__
+#define __PATH_INDEX_H__
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+* @brief The extensions a media file may have; a key resolves to one of them
+**/
+extern const std::unordered_set<std::string> VALID_EXTENSIONS;
+
+/**
+* @brief A file resolved from its logical key (the path without its extension)
+**/
+struct IndexedFile {
+    std::string path;
+    std::string extension;
+    uintmax_t size;
+    time_t mtime;
+};
+
+/**
+* @brief Counters of the path index
+**/
+struct PathIndexStats {
+    uint64_t entries;
+    uint64_t hits;
+    uint64_t negative_hits;
+    uint64_t fallbacks;
+    uint64_t rescans;
+    bool authoritative;
+};
+
+/**
+* @brief Concurrent map from "Mangas/<user>/<slug>/<chapter>/<page>" style keys to the
+* file that currently backs them. It is filled by a parallel scan at startup and kept
+* current by handleFileWrite and an inotify watcher. While the index is authoritative
+* (scan finished, every directory watched, no event lost) a missing key is a definitive
+* 404, so probes for pages that do not exist never reach the disk.
+**/
+class PathIndex {
+public:
+    explicit PathIndex(size_t shard_count = 32);
+    ~PathIndex();
+
+    /**
+    * @brief Scans the roots in parallel and starts watching them for changes
+    * @param roots The directories that hold the media (Mangas, Media)
+    * @param threads Number of scanning threads
+    **/
+    void start(const std::vector<std::string>& roots, size_t threads);
+
+    /**
+    * @brief Resolves a logical key
+    * @param key The path of the resource without its extension
+    * @return The indexed file, or nullopt if the key is not indexed
+    **/
+    std::optional<IndexedFile> lookup(const std::string& key);
+
+    /**
+    * @brief Whether a failed lookup() can be trusted as "the file does not exist"
+    **/
+    bool authoritative() const;
+
+    /**
+    * @brief Re-stats a path and records it, or drops it if it no longer exists
+    * @param path The path of the file with its extension
+    **/
+    void update(const std::string& path);
+
+    /**
+    * @brief Drops a path from the index if it is the one recorded for its key
+    * If another extension of the same key is still on disk (1.jpeg and 1.png), in either
+    * storage layout, that file is recorded instead.
+    * @param path The path of the file with its extension
+    **/
+    void remove(const std::string& path);
+
+    /**
+    * @brief Counts a lookup that had to fall back to probing the filesystem
+    **/
+    void countFallback();
+
+    /**
+    * @return A snapshot of the index counters
+    **/
+    PathIndexStats stats() const;
+
+    /**
+    * @brief Splits a file path into its logical key and its extension
+    * The key is the same whatever the storage layout the file is in.
+    * @param path The path of the file
+    * @param extension Output: the extension without the dot
+    * @return The path without the extension
+    **/
+    static std::string keyFor(const std::string& path, std::string* extension = nullptr);
+
+private:
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, IndexedFile> files;
+    };
+
+    Shard& shardFor(const std::string& key);
+    void scan(const std::vector<std::string>& roots, size_t threads);
+    void scanDirectory(const std::string& directory);
+    void record(const std::string& path, uintmax_t size, time_t mtime, bool replace);
+    void removePrefix(const std::string& prefix);
+    void addChild(const std::string& path);
+    void dropChild(const std::string& path);
+    void rescan();
+    void watchTree(const std::string& directory);
+    void unwatchTree(const std::string& directory);
+    void watchLoop();
+
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    // Directory on disk -> names of the files recorded from it, ordered so a removed
+    // directory only visits its own subtree. Locked after a shard, never before.
+    std::mutex tree_mutex;
+    std::map<std::string, std::unordered_set<std::string>> children;
+
+    std::vector<std::string> roots;
+    size_t scan_threads = 1;
+
+    int inotify_fd = -1;
+    std::mutex watches_mutex;
+    std::unordered_map<int, std::string> watches;
+    std::thread watcher;
+
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> is_authoritative{false};
+    std::atomic<bool> watch_failed{false};
+    std::atomic<uint64_t> entries{0};
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> negative_hits{0};
+    std::atomic<uint64_t> fallbacks{0};
+    std::atomic<uint64_t> rescans{0};
+};
+
+/**
+* @brief The process wide path index
+* @return The index shared by every route
+**/
+PathIndex& path_index();
+
+#endif
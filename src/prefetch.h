@@ -0,0 +1,83 @@
+#ifndef __PREFETCH_H__
+#define __PREFETCH_H__
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+* @brief A page chosen to be warmed ahead of the reader
+**/
+struct PrefetchPage {
+    std::string path;   // The file, with its extension
+    uintmax_t size;
+    bool cache;         // Load it into the hot-file cache; otherwise only hint the kernel
+};
+
+/**
+* @brief Decides which chapter pages to read ahead and measures whether it pays off.
+* When page N of a chapter is served, pages N+1..N+PREFETCH_WINDOW that the path index
+* knows are planned for warming. Each client IP may have at most
+* PREFETCH_HOST_BUDGET bytes warmed and not yet requested; the bytes of a page are given
+* back when the client asks for it (a hit) or after PREFETCH_TTL seconds (wasted).
+* Pages go to the hot-file cache only when it has free room, as speculative entries that
+* never evict anything; otherwise the kernel is asked to read them into the page cache.
+**/
+class Prefetcher {
+public:
+    /**
+    * @brief Records that a page was requested, counting a hit if it had been warmed
+    * @param key The logical key of the page, "Mangas/<user>/<slug>/<chapter>/<page>"
+    **/
+    void served(const std::string& key);
+
+    /**
+    * @brief Chooses the pages to warm after the one just served and reserves their bytes
+    * @param client The client IP the budget is charged to
+    * @param chapter_key The logical key of the chapter, "Mangas/<user>/<slug>/<chapter>"
+    * @param page The page just served
+    * @return The pages to warm, possibly none
+    **/
+    std::vector<PrefetchPage> plan(const std::string& client, const std::string& chapter_key, int page);
+
+    /**
+    * @brief Asks the kernel to read a whole file into the page cache, without blocking on it
+    * @param path The file
+    **/
+    static void adviseWillNeed(const std::string& path);
+
+private:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct Warmed {
+        std::string client;
+        uintmax_t size;
+        int64_t warmed_at;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Warmed> pages;
+    };
+
+    Shard& shardFor(const std::string& key);
+    void refund(const std::string& client, uintmax_t size);
+    void expire(int64_t now, int64_t ttl);
+
+    std::array<Shard, SHARD_COUNT> shards;
+
+    std::mutex budget_mutex;
+    std::unordered_map<std::string, uintmax_t> outstanding;   // Bytes warmed per client and not yet requested
+    int64_t last_expiry = 0;
+};
+
+/**
+* @brief The process wide read-ahead planner, tuned with PREFETCH_WINDOW, PREFETCH_HOST_BUDGET and PREFETCH_TTL
+**/
+Prefetcher& prefetcher();
+
+#endif
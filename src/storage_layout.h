@@ -0,0 +1,106 @@
+#ifndef __STORAGE_LAYOUT_H__
+#define __STORAGE_LAYOUT_H__
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+* How logical paths map to the disk.
+* Flat: the logical path is the path on disk ("Mangas/<user>/<slug>/<chapter>/<page>.<ext>")
+* Sharded: every directory goes under two levels of hex fan-out picked by the hash of its
+* logical path ("Mangas/.shards/3f/a0/<user>/<slug>/<chapter>/<page>.<ext>")
+**/
+enum class LayoutMode { Flat, Sharded };
+
+/**
+* @brief The single place that turns the logical paths built from URLs into paths on disk.
+* URLs, path index keys and cache validators keep using logical paths; only the files move.
+* The hash covers the whole logical directory, so the files of one chapter or post stay
+* together while users, slugs and posts spread over 65536 shard directories and no
+* directory grows with the number of uploads. Website assets are never sharded.
+* Reads accept both layouts: the path index maps the physical paths of either one back to
+* their logical key, and the fallbacks probe both, so a tree can be migrated while served.
+**/
+class StorageLayout {
+public:
+    static constexpr const char* SHARD_DIR = ".shards";
+
+    explicit StorageLayout(LayoutMode mode);
+
+    LayoutMode mode() const { return layout_mode; }
+
+    /**
+    * @brief Where new files of a logical directory are written
+    * @param logical_dir e.g. "Mangas/<user>/<slug>/<chapter>"
+    **/
+    std::string directory(const std::string& logical_dir) const;
+
+    /**
+    * @brief Where a logical file is written
+    * @param logical_path e.g. "Media/<user>/profilepicture.jpg"
+    **/
+    std::string place(const std::string& logical_path) const;
+
+    /**
+    * @brief Every directory a logical directory may be on disk, the current layout first
+    **/
+    std::vector<std::string> directories(const std::string& logical_dir) const;
+
+    /**
+    * @brief Every path a logical file may be on disk, the current layout first
+    **/
+    std::vector<std::string> places(const std::string& logical_path) const;
+
+    /**
+    * @brief Whether a logical directory is subject to sharding
+    * Roots themselves and Media/Website are not.
+    **/
+    static bool shardable(const std::string& logical_dir);
+
+    /**
+    * @brief The sharded path of a logical directory, or the directory itself if it is not shardable
+    **/
+    static std::string shardedDirectory(const std::string& logical_dir);
+
+    /**
+    * @brief The logical path of a path on disk, in either layout
+    * @param physical e.g. "Mangas/.shards/3f/a0/<user>/<slug>/<chapter>/<page>.<ext>"
+    **/
+    static std::string logical(const std::string& physical);
+
+private:
+    LayoutMode layout_mode;
+};
+
+/**
+* @brief The process wide layout, chosen with STORAGE_LAYOUT (flat or sharded)
+**/
+StorageLayout& storage_layout();
+
+/**
+* @brief Result of a layout migration
+**/
+struct LayoutMigrationStats {
+    uint64_t moved;        // Files (and variants) now in the target layout
+    uint64_t superseded;   // Old copies dropped because the target layout already had a file
+    uint64_t failed;
+    uint64_t directories;  // Emptied directories of the old layout that were removed
+};
+
+/**
+* @brief Moves every file of the roots into the layout, while the server keeps serving.
+* Each file is hardlinked into place (never overwriting a file already there, which wins)
+* and only unlinked from its old path after a grace period, so a request that resolved the
+* old path just before the move still finds it. Derived variants move with their original;
+* bundles of the old layout are dropped and rebuilt on demand. Running it twice is harmless.
+* @param roots The storage roots, e.g. {"Mangas", "Media"}
+* @param layout The layout to migrate to
+* @param grace How long both copies are kept before the old one is unlinked
+* @param dry_run Only count what would move
+**/
+LayoutMigrationStats migrate_layout(const std::vector<std::string>& roots, const StorageLayout& layout,
+                                    std::chrono::milliseconds grace, bool dry_run);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* @brief Fixed size pool of worker threads fed from a FIFO queue.
+* Used for background work that must not run on Crow's worker threads
+* or must be bounded (parallel page writes, scans, derivatives).
+**/
+class ThreadPool {
+public:
+    /**
+    * @param threads Number of worker threads, at least 1
+    **/
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+    * @brief Queues a task and returns a future with its result
+    * @param task The callable to run on a worker
+    * @return The future of the result of the task
+    **/
+    template <class F>
+    auto submit(F&& task) -> std::future<decltype(task())> {
+        using Result = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        post([packaged] { (*packaged)(); });
+        return result;
+    }
+
+    /**
+    * @brief Queues a task without a result
+    * @param task The callable to run on a worker
+    **/
+    void post(std::function<void()> task);
+
+    /**
+    * @return Number of tasks waiting for a worker
+    **/
+    size_t pending() const;
+
+    /**
+    * @return Number of worker threads
+    **/
+    size_t size() const { return workers.size(); }
+
+private:
+    void run();
+
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+};
+
+#endif
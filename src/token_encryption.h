@@ -4,6 +4,13 @@
 #include <vector>
 #include <string>
 
+/**
+* @brief How tokens are turned into the values stored in the token store
+* Aes: ENCRYPTION_ROUNDS rounds of AES-256-CBC (the original format, cost grows with the rounds)
+* Hmac: a single HMAC-SHA256, constant cost whatever the round count
+**/
+enum class TokenDigestMode { Aes, Hmac };
+
 /**
 * @brief Decrypts a token using the provided key and rounds
 * @param encrypted_token The token to decrypt
@@ -22,6 +29,32 @@ std::string decrypt_token(const std::string& encrypted_token, const std::string&
 **/
 std::string encrypt_token(const std::string& token, const std::string& key, int rounds);
 
+/**
+* @brief Computes the HMAC-SHA256 of a token as a hex string
+* @param token The token to digest
+* @param key The secret key
+* @return 64 hex characters
+**/
+std::string hmac_token(const std::string& token, const std::string& key);
+
+/**
+* @brief Derives the stored form of a token with the given mode
+* @param token The token to digest
+* @param key The secret key
+* @param rounds The number of AES rounds, ignored in Hmac mode
+* @param mode The derivation to use
+* @return The hex digest of the token
+**/
+std::string digest_token(const std::string& token, const std::string& key, int rounds, TokenDigestMode mode);
+
+/**
+* @brief Computes the SHA-256 of a buffer as a hex string
+* @param data The bytes to hash
+* @param size The number of bytes
+* @return 64 lowercase hex characters
+**/
+std::string sha256_hex(const char* data, size_t size);
+
 /**
 * @brief Converts a vector of bytes to a hex string
 * @param data The vector of bytes to convert
@@ -0,0 +1,199 @@
+#ifndef __TOKEN_STORE_H__
+#define __TOKEN_STORE_H__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sw/redis++/redis++.h>
+#include "thread_pool.h"
+
+#if __has_include(<sw/redis++/async_redis++.h>)
+#include <sw/redis++/async_redis++.h>
+#define PDFAST_ASYNC_REDIS 1
+#endif
+
+/**
+* Result of validating and consuming a CSRF token in one step.
+* Valid: the token matched and one use was consumed
+* NotFound: there is no token stored for the session
+* Mismatch: the session exists but the token is different
+* Expired: the use counter no longer exists
+* Exhausted: the token has no remaining uses
+* Unavailable: the store could not be reached (timeout, connection error, pool exhausted)
+**/
+enum class TokenStatus { Valid, NotFound, Mismatch, Expired, Exhausted, Unavailable };
+
+/**
+* @brief Storage of CSRF tokens and their remaining uses
+* The backend is chosen with TOKEN_STORE in .env (redis by default, or memory).
+**/
+class TokenStore {
+public:
+    virtual ~TokenStore() = default;
+
+    /**
+    * @brief Stores a token and its use counter
+    * @param session_key The digested session ID
+    * @param token_value The digested CSRF token
+    * @param max_uses The number of writes allowed with the token
+    * @param ttl_seconds Lifetime of the token
+    **/
+    virtual void store(const std::string& session_key, const std::string& token_value, int max_uses, int ttl_seconds) = 0;
+
+    /**
+    * @brief Compares the token, checks the remaining uses and consumes one atomically
+    * @param session_key The digested session ID
+    * @param token_value The digested CSRF token sent by the client
+    * @return The status of the token
+    **/
+    virtual TokenStatus consume(const std::string& session_key, const std::string& token_value) = 0;
+
+    /**
+    * @brief Same as consume, without holding the calling thread while the store answers
+    * The default implementation calls consume and then done on the calling thread.
+    * @param done Receives the status of the token, possibly on another thread
+    **/
+    virtual void consumeAsync(const std::string& session_key, const std::string& token_value,
+                              std::function<void(TokenStatus status)> done);
+};
+
+/**
+* Connection settings of the Redis token store, read from REDIS_* in .env.
+**/
+struct RedisSettings {
+    std::string url;
+    size_t pool_size;                              // Connections shared by every worker thread
+    std::chrono::milliseconds connect_timeout;
+    std::chrono::milliseconds socket_timeout;      // Per reply; a slow Redis fails instead of hanging
+    std::chrono::milliseconds pool_wait_timeout;   // How long a call waits for a free connection
+    std::chrono::seconds connection_lifetime;      // 0 keeps connections forever
+    bool keep_alive;
+    bool async;                                    // Consume tokens through AsyncRedis when compiled in
+};
+
+/**
+* @brief Token store backed by Redis. Consumption is a Lua script called with EVALSHA,
+* issuance a pipelined MULTI/EXEC.
+* Every synchronous call first takes one of pool_size slots, so the time spent waiting for
+* a connection is measured (phase redis_pool_wait) and bounded by pool_wait_timeout.
+* Redis errors are counted; consume and matches report them as Unavailable / no match,
+* store rethrows them. With async enabled consumption goes through AsyncRedis and the
+* callback is handed to a small pool, never run on the Redis event loop.
+**/
+class RedisTokenStore : public TokenStore {
+public:
+    explicit RedisTokenStore(const RedisSettings& settings);
+
+    void store(const std::string& session_key, const std::string& token_value, int max_uses, int ttl_seconds) override;
+    TokenStatus consume(const std::string& session_key, const std::string& token_value) override;
+    void consumeAsync(const std::string& session_key, const std::string& token_value,
+                      std::function<void(TokenStatus status)> done) override;
+
+private:
+    std::string scriptSha(bool reload);
+
+    template <class F>
+    auto call(F&& command) -> decltype(command());
+
+    std::chrono::milliseconds pool_wait_timeout;
+    std::counting_semaphore<> slots;
+    sw::redis::Redis redis;
+    std::mutex script_mutex;
+    std::string script_sha;
+
+#ifdef PDFAST_ASYNC_REDIS
+    void consumeAsync(const std::string& session_key, const std::string& token_value, bool use_script,
+                      std::function<void(TokenStatus status)> done);
+
+    std::unique_ptr<sw::redis::AsyncRedis> async_redis;
+    std::unique_ptr<ThreadPool> continuations;
+#endif
+};
+
+/**
+* @brief In-process token store for single node deployments.
+* Tokens live in a sharded hash map; expiry is driven by a hierarchical timing wheel
+* (3 levels of 64 one-second slots) advanced by a background thread, and is also
+* checked on access so an overdue tick never lets an expired token through.
+* If a snapshot path is configured the tokens are written to disk periodically and
+* on shutdown, and loaded back on startup.
+**/
+class MemoryTokenStore : public TokenStore {
+public:
+    /**
+    * @param snapshot_path File used to persist tokens across restarts, empty to disable
+    * @param snapshot_interval Seconds between snapshots
+    **/
+    MemoryTokenStore(const std::string& snapshot_path, int snapshot_interval);
+    ~MemoryTokenStore() override;
+
+    void store(const std::string& session_key, const std::string& token_value, int max_uses, int ttl_seconds) override;
+    TokenStatus consume(const std::string& session_key, const std::string& token_value) override;
+
+    /**
+    * @return Number of tokens currently stored
+    **/
+    size_t size() const;
+
+private:
+    static constexpr int SHARD_COUNT = 64;
+    static constexpr int WHEEL_BITS = 6;
+    static constexpr int WHEEL_SLOTS = 1 << WHEEL_BITS;
+    static constexpr int WHEEL_LEVELS = 3;
+
+    struct Token {
+        std::string value;
+        int uses;
+        int64_t expires_at;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, Token> tokens;
+    };
+
+    struct Timer {
+        std::string session_key;
+        int64_t expires_at;
+    };
+
+    Shard& shardFor(const std::string& session_key);
+    void insert(const std::string& session_key, Token token);
+    void schedule(const std::string& session_key, int64_t expires_at);
+    void expire(const Timer& timer);
+    void advance(int64_t now);
+    void run();
+    void saveSnapshot() const;
+    void loadSnapshot();
+
+    std::array<Shard, SHARD_COUNT> shards;
+
+    std::mutex wheel_mutex;
+    std::array<std::array<std::vector<Timer>, WHEEL_SLOTS>, WHEEL_LEVELS> wheel;
+    int64_t current_tick;
+
+    std::string snapshot_path;
+    int snapshot_interval;
+
+    std::mutex run_mutex;
+    std::condition_variable run_cv;
+    bool stopping = false;
+    std::thread ticker;
+};
+
+/**
+* @brief The process wide token store selected by TOKEN_STORE
+* @return The token store shared by every route
+**/
+TokenStore& token_store();
+
+#endif